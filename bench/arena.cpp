@@ -0,0 +1,94 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Allocation tail latency of arena selection modes
+//*
+//*     Build: g++ -O2 -std=c++17 -pthread -I bench -I . bench/arena.cpp -o arena
+//*     Run:   ./arena [operations per thread, default 200000]
+//*
+//*     Threads free and reallocate random chunks of 16..256 bytes, every
+//*     thread keeps 1000 chunks. Latency of every free()/malloc() pair is
+//*     recorded for one manager and for a set of 4 arenas in WAIT, TRY_NEXT
+//*     and TRY_NEXT_REBIND modes, with 1 to 32 threads.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "heap.h"
+#include "heap_arena.h"
+
+typedef heap::manager<heap_guard>      manager;
+typedef heap::arena_set<heap_guard, 4> arenas;
+typedef std::chrono::steady_clock      clock_type;
+
+static size_t const LIVE = 1000;        // chunks kept by every thread
+static int          HeapPool[(64 << 20) / sizeof(int)];
+
+//------------------------------------------------------------------------------
+template<typename heap_type>
+static void run(char const *name, heap_type & Heap, unsigned threads, size_t ops)
+{
+    std::vector<double> latency(threads * ops);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&Heap, &latency, t, ops]()
+        {
+            std::vector<void *> live(LIVE);
+            unsigned seed = t + 1;
+            for(size_t i = 0; i < LIVE; ++i)
+                live[i] = Heap.malloc(16 + rand_r(&seed) % 241);
+            for(size_t i = 0; i < ops; ++i)
+            {
+                size_t k = rand_r(&seed) % LIVE;
+                clock_type::time_point start = clock_type::now();
+                Heap.free(live[k]);
+                live[k] = Heap.malloc(16 + rand_r(&seed) % 241);
+                latency[t * ops + i] = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+            }
+            for(size_t i = 0; i < LIVE; ++i)
+                Heap.free(live[i]);
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+
+    std::sort(latency.begin(), latency.end());
+    size_t n = latency.size();
+    printf("%7u  %-16s %8.0f %8.0f %8.0f %10.0f\n", threads, name,
+           latency[n / 2], latency[n * 99 / 100], latency[n * 999 / 1000], latency[n - 1]);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], 0, 0) : 200000;
+    setvbuf(stdout, 0, _IOLBF, 0);
+
+    printf("threads  heap                  p50      p99    p99.9        max  (ns per free/malloc pair)\n");
+    for(unsigned threads = 1; threads <= 32; threads *= 2)
+    {
+        {
+            manager Heap(HeapPool);
+            run("manager", Heap, threads, ops);
+        }
+        {
+            arenas Heap(HeapPool, sizeof(HeapPool), arenas::WAIT);
+            run("WAIT", Heap, threads, ops);
+        }
+        {
+            arenas Heap(HeapPool, sizeof(HeapPool), arenas::TRY_NEXT);
+            run("TRY_NEXT", Heap, threads, ops);
+        }
+        {
+            arenas Heap(HeapPool, sizeof(HeapPool), arenas::TRY_NEXT_REBIND);
+            run("TRY_NEXT_REBIND", Heap, threads, ops);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Bitmap heap against free list first fit at high occupancy
+//*
+//*     Build: g++ -O2 -std=c++17 -I bench -I . bench/bitmap.cpp -o bitmap
+//*     Run:   ./bitmap [operations, default 20000]
+//*
+//*     Heap of 16 MiB is filled with chunks of 16..256 bytes (multiples of
+//*     16), random chunks are released until the occupancy is reached. Then
+//*     a random chunk is released and a new one is allocated, time is per
+//*     free()/malloc() pair. Failed allocations are counted.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include <random>
+#include "heap.h"
+#include "heap_bitmap.h"
+
+typedef heap::manager<heap_guard>            manager;
+typedef heap::bitmap_manager<heap_guard, 16> bitmap;
+typedef std::chrono::steady_clock            clock_type;
+
+static size_t const SIZE = 16 << 20;
+static int          HeapPool[SIZE / sizeof(int)];
+
+//------------------------------------------------------------------------------
+template<typename heap_type>
+static void run(char const *name, double occupancy, size_t ops)
+{
+    heap_type Heap(HeapPool, SIZE);
+
+    std::mt19937 rng(1);
+    std::vector<void *> live;
+    for(;;)
+    {
+        void *ptr = Heap.malloc(16 * (1 + rng() % 16));
+        if( !ptr )
+            break;
+        live.push_back(ptr);
+    }
+    size_t keep = (size_t)(live.size() * occupancy);
+    while( live.size() > keep )
+    {
+        size_t k = rng() % live.size();
+        Heap.free(live[k]);
+        live[k] = live.back();
+        live.pop_back();
+    }
+
+    size_t failed = 0;
+    clock_type::time_point start = clock_type::now();
+    for(size_t i = 0; i < ops; ++i)
+    {
+        size_t k = rng() % live.size();
+        Heap.free(live[k]);
+        live[k] = Heap.malloc(16 * (1 + rng() % 16));
+        if( !live[k] )
+        {
+            ++failed;
+            live[k] = live.back();
+            live.pop_back();
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    printf("%5.0f%%  %-8s %8.1f %8zu\n", occupancy * 100, name, ns / ops, failed);
+
+    for(size_t i = 0; i < live.size(); ++i)
+        Heap.free(live[i]);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], 0, 0) : 20000;
+
+    printf("occup.  heap      ns/pair   failed\n");
+    double const occupancy[] = { 0.5, 0.9, 0.99 };
+    for(size_t i = 0; i < sizeof(occupancy) / sizeof(occupancy[0]); ++i)
+    {
+        run<manager>("manager", occupancy[i], ops);
+        run<bitmap>("bitmap", occupancy[i], ops);
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Spawn-heavy coroutine workload with frame cache
+//*
+//*     Build: g++ -O2 -std=c++20 -pthread -I bench -I . bench/coro.cpp -o coro
+//*     Run:   ./coro [trees per thread, default 200]
+//*
+//*     Every thread evaluates trees of lazy tasks 14 levels deep: every
+//*     task spawns and awaits two child tasks, so each tree creates and
+//*     destroys 32767 coroutine frames. Frames are allocated by global
+//*     operator new, by guarded malloc()/free() of the manager and by
+//*     heap::coroutine_frames, with 1 to 8 threads.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <coroutine>
+#include <new>
+#include <thread>
+#include <vector>
+#include "heap.h"
+#include "heap_coro.h"
+
+typedef heap::manager<heap_guard> manager;
+typedef std::chrono::steady_clock clock_type;
+
+static int const DEPTH = 14;
+static int       HeapPool[(16 << 20) / sizeof(int)];
+static manager   Heap(HeapPool);
+
+//------------------------------------------------------------------------------
+//  Frame allocation of the promise
+struct global_frames
+{
+    static void *operator new(size_t size) noexcept { return ::operator new(size, std::nothrow); }
+    static void  operator delete(void *ptr, size_t) { ::operator delete(ptr); }
+};
+
+struct manager_frames
+{
+    static void *operator new(size_t size) noexcept { return Heap.malloc(size); }
+    static void  operator delete(void *ptr, size_t) { Heap.free(ptr); }
+};
+
+typedef heap::coroutine_frames<heap_guard, Heap> cached_frames;
+
+//------------------------------------------------------------------------------
+//  Lazy task, started by co_await, resumes the awaiting coroutine when done
+template<typename frames>
+class task
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> handle;
+
+    struct final_awaiter
+    {
+        bool                    await_ready() noexcept                { return false; }
+        std::coroutine_handle<> await_suspend(handle h) noexcept      { return h.promise().Continuation; }
+        void                    await_resume() noexcept               { }
+    };
+
+    struct promise_type : frames
+    {
+        int                     Value;
+        std::coroutine_handle<> Continuation;
+
+        task                get_return_object()                        { return task(handle::from_promise(*this)); }
+        static task         get_return_object_on_allocation_failure() { return task(handle()); }
+        std::suspend_always initial_suspend() noexcept                 { return std::suspend_always(); }
+        final_awaiter       final_suspend() noexcept                   { return final_awaiter(); }
+        void                return_value(int value)                    { Value = value; }
+        void                unhandled_exception()                      { abort(); }
+    };
+
+    task(task && other) : H(other.H) { other.H = handle(); }
+    ~task() { if( H ) H.destroy(); }
+
+    bool                    await_ready()                              { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> c)   { H.promise().Continuation = c; return H; }
+    int                     await_resume()                             { return H.promise().Value; }
+
+    // Run to completion from ordinary function
+    int get()
+    {
+        H.promise().Continuation = std::noop_coroutine();
+        H.resume();
+        return H.promise().Value;
+    }
+
+    bool valid() const { return (bool)H; }
+
+private:
+    explicit task(handle h) : H(h) { }
+    handle H;
+};
+
+//------------------------------------------------------------------------------
+template<typename frames>
+static task<frames> tree(int depth)
+{
+    if( !depth )
+        co_return 1;
+
+    task<frames> left  = tree<frames>(depth - 1);
+    task<frames> right = tree<frames>(depth - 1);
+    if( !left.valid() || !right.valid() )
+        abort();
+    co_return co_await left + co_await right + 1;
+}
+
+//------------------------------------------------------------------------------
+template<typename frames>
+static void run(char const *name, unsigned threads, size_t trees)
+{
+    std::vector<std::thread> workers;
+    clock_type::time_point start = clock_type::now();
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([trees]()
+        {
+            for(size_t i = 0; i < trees; ++i)
+            {
+                task<frames> root = tree<frames>(DEPTH);
+                if( !root.valid() || root.get() != (2 << DEPTH) - 1 )
+                    abort();
+            }
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+
+    double frames_total = (double)threads * trees * ((2 << DEPTH) - 1);
+    printf("%7u  %-18s %8.1f\n", threads, name, ns / frames_total);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t trees = argc > 1 ? strtoul(argv[1], 0, 0) : 200;
+    setvbuf(stdout, 0, _IOLBF, 0);
+
+    printf("threads  frames              ns/frame\n");
+    for(unsigned threads = 1; threads <= 8; threads *= 2)
+    {
+        run<global_frames>("operator new", threads, trees);
+        run<manager_frames>("manager", threads, trees);
+        run<cached_frames>("coroutine_frames", threads, trees);
+    }
+    return 0;
+}
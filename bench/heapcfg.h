@@ -0,0 +1,19 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Heap configuration for benchmark programs
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAPCFG_H__
+#define HEAPCFG_H__
+
+#include <mutex>
+#include <shared_mutex>
+
+// lock()/try_lock()/unlock() and lock_shared()/unlock_shared()
+struct heap_guard : std::shared_mutex
+{
+};
+
+#endif  // HEAPCFG_H__
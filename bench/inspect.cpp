@@ -0,0 +1,119 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Allocation latency while monitoring threads inspect heap
+//*
+//*     Build: g++ -O2 -std=c++17 -pthread -I bench -I . bench/inspect.cpp -o inspect
+//*     Run:   ./inspect [allocations per thread, default 200000]
+//*
+//*     Two threads allocate and release chunks of 16..256 bytes in a heap
+//*     of 20000 chunks and record latency of every malloc()/free() pair.
+//*     Two monitoring threads meanwhile call info() with exclusive guard,
+//*     info() with shared guard or stats() that takes no guard, with 100 us
+//*     pause after every call. Idle monitors only wake up with the same 
+//*     period, they show the cost of thread switches alone.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "heap.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+// Guard without lock_shared(): inspection serializes with everything
+struct exclusive_guard
+{
+    void lock()     { Mutex.lock(); }
+    bool try_lock() { return Mutex.try_lock(); }
+    void unlock()   { Mutex.unlock(); }
+    std::mutex Mutex;
+};
+
+enum monitor_mode { NONE, IDLE, INFO, STATS };
+
+static size_t const THREADS  = 2;
+static size_t const MONITORS = 2;
+static size_t const LIVE     = 10000;   // chunks kept by every allocating thread
+static int    const PERIOD   = 100;     // pause between walks of a monitor, us
+
+//------------------------------------------------------------------------------
+template<typename guard>
+static void run(char const *name, monitor_mode mode, size_t ops)
+{
+    static int HeapPool[(16 << 20) / sizeof(int)];
+    heap::manager<guard> Heap(HeapPool);
+
+    std::atomic<bool>   Done(false);
+    std::atomic<size_t> Walks(0);
+    std::vector<std::thread> monitors;
+    for(size_t m = 0; mode != NONE && m < MONITORS; ++m)
+    {
+        monitors.push_back(std::thread([&]()
+        {
+            while( !Done.load(std::memory_order_relaxed) )
+            {
+                if( mode == INFO )
+                    Heap.info();
+                else if( mode == STATS )
+                    Heap.stats();
+                Walks.fetch_add(1, std::memory_order_relaxed);
+                std::this_thread::sleep_for(std::chrono::microseconds(PERIOD));
+            }
+        }));
+    }
+
+    std::vector<double> latency(THREADS * ops);
+    std::vector<std::thread> workers;
+    for(size_t t = 0; t < THREADS; ++t)
+    {
+        workers.push_back(std::thread([&Heap, &latency, t, ops]()
+        {
+            std::vector<void *> live(LIVE);
+            unsigned seed = (unsigned)t + 1;
+            for(size_t i = 0; i < LIVE; ++i)
+                live[i] = Heap.malloc(16 + rand_r(&seed) % 241);
+            for(size_t i = 0; i < ops; ++i)
+            {
+                size_t k = rand_r(&seed) % LIVE;
+                clock_type::time_point start = clock_type::now();
+                Heap.free(live[k]);
+                live[k] = Heap.malloc(16 + rand_r(&seed) % 241);
+                latency[t * ops + i] = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+            }
+            for(size_t i = 0; i < LIVE; ++i)
+                Heap.free(live[i]);
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    Done.store(true);
+    for(size_t m = 0; m < monitors.size(); ++m)
+        monitors[m].join();
+
+    std::sort(latency.begin(), latency.end());
+    size_t n = latency.size();
+    printf("%-16s %8.0f %8.0f %8.0f %10.0f %8zu\n", name,
+           latency[n / 2], latency[n * 99 / 100], latency[n * 999 / 1000], latency[n - 1], Walks.load());
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], 0, 0) : 200000;
+    setvbuf(stdout, 0, _IOLBF, 0);
+
+    printf("monitor               p50      p99    p99.9        max    walks  (ns per free/malloc pair)\n");
+    run<heap_guard>("none", NONE, ops);
+    run<heap_guard>("idle", IDLE, ops);
+    run<exclusive_guard>("info, exclusive", INFO, ops);
+    run<heap_guard>("info, shared", INFO, ops);
+    run<heap_guard>("stats", STATS, ops);
+    return 0;
+}
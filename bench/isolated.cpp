@@ -0,0 +1,71 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: False sharing of small chunks with and without ISOLATED
+//*
+//*     Build: g++ -O2 -std=c++17 -pthread -I bench -I . bench/isolated.cpp -o isolated
+//*     Run:   ./isolated [increments per thread, default 100000000]
+//*
+//*     Counters of 4 threads are allocated one after another, by plain
+//*     malloc() (neighbour chunks share cache lines) and with ISOLATED flag
+//*     (every chunk has its own lines). Every thread increments its own
+//*     counter; time per increment shows the cache line ping-pong.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+#include "heap.h"
+
+typedef heap::manager<heap_guard> manager;
+typedef std::chrono::steady_clock clock_type;
+
+static unsigned const THREADS = 4;
+static int            HeapPool[(1 << 20) / sizeof(int)];
+static manager        Heap(HeapPool);
+
+//------------------------------------------------------------------------------
+static void run(char const *name, unsigned flags, size_t ops)
+{
+    std::atomic<size_t> *counter[THREADS];
+    for(unsigned t = 0; t < THREADS; ++t)
+        counter[t] = new (Heap.malloc(sizeof(std::atomic<size_t>), 0, flags)) std::atomic<size_t>(0);
+
+    std::vector<std::thread> workers;
+    clock_type::time_point start = clock_type::now();
+    for(unsigned t = 0; t < THREADS; ++t)
+    {
+        std::atomic<size_t> *c = counter[t];
+        workers.push_back(std::thread([c, ops]()
+        {
+            for(size_t i = 0; i < ops; ++i)
+                c->fetch_add(1, std::memory_order_relaxed);
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+
+    printf("%-10s", name);
+    for(unsigned t = 0; t < THREADS; ++t)
+        printf(" %p", (void *)counter[t]);
+    printf("  %6.2f ns/increment\n", ns / ops);
+
+    for(unsigned t = 0; t < THREADS; ++t)
+        Heap.free(counter[t]);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], 0, 0) : 100000000;
+
+    run("plain", 0, ops);
+    run("ISOLATED", manager::ISOLATED, ops);
+    return 0;
+}
@@ -0,0 +1,89 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Lock-free node pool against guarded manager allocation
+//*
+//*     Build: g++ -O2 -std=c++17 -pthread -I bench -I . bench/nodepool.cpp -o nodepool
+//*     Run:   ./nodepool [operations per thread, default 1000000]
+//*
+//*     Every thread allocates 16 nodes of 32 bytes and releases them, by
+//*     node_pool and by manager malloc()/free(), with 1 to 64 threads.
+//*     Time is wall clock per malloc/free pair of all threads together.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "heap.h"
+#include "heap_nodepool.h"
+
+typedef heap::manager<heap_guard> manager;
+typedef heap::node_pool<heap_guard, 32, 256, 64> pool_type;
+typedef std::chrono::steady_clock clock_type;
+
+static int     HeapPool[(64 << 20) / sizeof(int)];
+static manager Heap(HeapPool);
+
+static size_t const BATCH = 16;
+
+//------------------------------------------------------------------------------
+struct pool_nodes
+{
+    pool_type & Pool;
+    void *get()           { return Pool.malloc(); }
+    void  put(void *ptr)  { Pool.free(ptr); }
+};
+
+struct heap_nodes
+{
+    void *get()           { return Heap.malloc(32); }
+    void  put(void *ptr)  { Heap.free(ptr); }
+};
+
+//------------------------------------------------------------------------------
+template<typename nodes>
+static double run(nodes source, unsigned threads, size_t ops)
+{
+    std::vector<std::thread> workers;
+    clock_type::time_point start = clock_type::now();
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([source, ops]() mutable
+        {
+            void *batch[BATCH];
+            for(size_t i = 0; i < ops; i += BATCH)
+            {
+                for(size_t k = 0; k < BATCH; ++k)
+                    batch[k] = source.get();
+                for(size_t k = 0; k < BATCH; ++k)
+                    source.put(batch[k]);
+            }
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    return ns / (ops * threads);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t ops = argc > 1 ? strtoul(argv[1], 0, 0) : 1000000;
+
+    pool_type Pool(Heap);
+    Pool.reserve(64 * BATCH);
+
+    printf("threads  node_pool  manager   (ns per malloc/free pair)\n");
+    for(unsigned threads = 1; threads <= 64; threads *= 2)
+    {
+        pool_nodes p = { Pool };
+        double pool_ns = run(p, threads, ops);
+        double heap_ns = run(heap_nodes(), threads, ops);
+        printf("%7u  %9.1f  %7.1f\n", threads, pool_ns, heap_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Chunk chain walk throughput on heaps larger than LLC
+//*
+//*     Build: g++ -O2 -std=c++17 -I bench -I . bench/scan.cpp -o scan
+//*     Run:   ./scan [heap size in MiB, default 1024]
+//*
+//*     Heap is filled with chunks of 16..256 bytes, every other chunk is
+//*     freed in random order. Walk of the free list is measured by the
+//*     request that no free chunk satisfies, walk of the whole chain by
+//*     info(). Redefine HEAP_PREFETCH_AHEAD (-DHEAP_PREFETCH_AHEAD=N) to
+//*     compare prefetch distances.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "heap.h"
+
+typedef heap::manager<heap_guard> manager;
+typedef std::chrono::steady_clock clock_type;
+
+//------------------------------------------------------------------------------
+static double elapsed_ns(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t size = (argc > 1 ? strtoul(argv[1], 0, 0) : 1024) << 20;
+    int   *pool = new int[size / sizeof(int)];
+    manager Heap(pool, size);
+
+    std::mt19937 rng(1);
+    std::vector<void *> chunks;
+    for(;;)
+    {
+        void *ptr = Heap.malloc(16 + rng() % 241);
+        if( !ptr )
+            break;
+        chunks.push_back(ptr);
+    }
+
+    std::vector<void *> holes;
+    for(size_t i = 0; i < chunks.size(); i += 2)
+        holes.push_back(chunks[i]);
+    std::shuffle(holes.begin(), holes.end(), rng);
+    for(size_t i = 0; i < holes.size(); ++i)
+        Heap.free(holes[i]);
+
+    manager::summary s = Heap.info();
+    printf("heap %zu MiB, %zu free chunks, %zu used chunks, prefetch ahead %d\n",
+           size >> 20, s.Free.Blocks, s.Used.Blocks, HEAP_PREFETCH_AHEAD);
+
+    double walk = 1e30, chain = 1e30;
+    for(int pass = 0; pass < 5; ++pass)
+    {
+        clock_type::time_point t = clock_type::now();
+        if( Heap.malloc(1024) )                 // larger than any free chunk
+            return 1;
+        walk = std::min(walk, elapsed_ns(t) / s.Free.Blocks);
+
+        t = clock_type::now();
+        Heap.info();
+        chain = std::min(chain, elapsed_ns(t) / (s.Free.Blocks + s.Used.Blocks));
+    }
+    printf("free list walk:  %6.2f ns/chunk\n", walk);
+    printf("chunk chain walk: %6.2f ns/chunk\n", chain);
+    return 0;
+}
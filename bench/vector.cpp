@@ -0,0 +1,121 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Relocations of log buffers built by appending lines
+//*
+//*     Build: g++ -O2 -std=c++17 -I bench -I . bench/vector.cpp -o vector
+//*     Run:   ./vector [lines, default 2000000]
+//*
+//*     8 log buffers are built at the same time, every line of 40..160
+//*     bytes is appended to a random buffer, a buffer is flushed (destroyed
+//*     and started again) when it reaches 64 KiB. Buffers are
+//*     heap::byte_buffer and std::vector<char> whose allocator uses the same
+//*     manager. Relocation is counted when storage address changes, copied
+//*     bytes are the contents moved by relocations.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "heap.h"
+#include "heap_vector.h"
+
+typedef heap::manager<heap_guard>     manager;
+typedef heap::byte_buffer<heap_guard> byte_buffer;
+typedef std::chrono::steady_clock     clock_type;
+
+static size_t const BUFFERS = 8;
+static size_t const FLUSH   = 64 << 10;
+static int          HeapPool[(16 << 20) / sizeof(int)];
+static manager      Heap(HeapPool);
+
+//------------------------------------------------------------------------------
+// std::vector storage from the same manager
+template<typename T>
+struct heap_allocator
+{
+    typedef T value_type;
+
+    heap_allocator() { }
+    template<typename U> heap_allocator(heap_allocator<U> const &) { }
+
+    T   *allocate(size_t count)           { return (T *)Heap.malloc(count * sizeof(T)); }
+    void deallocate(T *ptr, size_t)       { Heap.free(ptr); }
+
+    template<typename U> bool operator==(heap_allocator<U> const &) const { return true; }
+    template<typename U> bool operator!=(heap_allocator<U> const &) const { return false; }
+};
+
+typedef std::vector<char, heap_allocator<char> > std_buffer;
+
+// heap::byte_buffer of the same manager
+struct log_buffer : byte_buffer
+{
+    log_buffer() : byte_buffer(::Heap) { }
+};
+
+//------------------------------------------------------------------------------
+static bool append(log_buffer  & buf, char const *line, size_t length) { return buf.append(line, length); }
+static bool append(std_buffer  & buf, char const *line, size_t length)
+{
+    buf.insert(buf.end(), line, line + length);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template<typename buffer>
+static void run(char const *name, size_t lines)
+{
+    std::unique_ptr<buffer> buf[BUFFERS];
+    for(size_t b = 0; b < BUFFERS; ++b)
+        buf[b].reset(new buffer());
+
+    char line[160];
+    for(size_t i = 0; i < sizeof(line); ++i)
+        line[i] = 'a' + i % 26;
+
+    std::mt19937 rng(1);
+    size_t relocations = 0;
+    size_t copied      = 0;
+    size_t flushes     = 0;
+    clock_type::time_point start = clock_type::now();
+    for(size_t i = 0; i < lines; ++i)
+    {
+        size_t   b   = rng() % BUFFERS;
+        buffer & Buf = *buf[b];
+        char const *data = Buf.data();
+        size_t      size = Buf.size();
+        if( !append(Buf, line, 40 + rng() % 121) )
+        {
+            printf("%s: out of memory\n", name);
+            return;
+        }
+        if( size && Buf.data() != data )
+        {
+            ++relocations;
+            copied += size;
+        }
+        if( Buf.size() >= FLUSH )
+        {
+            buf[b].reset(new buffer());
+            ++flushes;
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    printf("%-12s %8zu %12zu %8zu %8.1f\n", name, relocations, copied, flushes, ns / lines);
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    size_t lines = argc > 1 ? strtoul(argv[1], 0, 0) : 2000000;
+
+    printf("buffer        relocs  copied bytes  flushes  ns/line\n");
+    run<log_buffer>("byte_buffer", lines);
+    run<std_buffer>("std::vector", lines);
+    return 0;
+}
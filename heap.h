@@ -64,13 +64,54 @@
 //  mcb.prev of the first MCB points to itself.
 //  start points to first MCB
 //  freemem points to first free MCB
+//
+//  Free chunks are also linked into doubly linked free list by the links kept
+//  in the first two words of their ASA, so allocated chunks carry no extra data:
+//
+//  freemem<=>{MCB_i:ASA_i}<=>{MCB_j:ASA_j}<=>...<=>{MCB_k:ASA_k}->0
+//
+//  Freed chunk is placed next to the nearest free chunk found among a few 
+//  neighbours in the ring, otherwise at the list head, so the list is only
+//  roughly address-ordered and every list operation is O(1). Search for a 
+//  free chunk walks this list only, the ring is used for joining of neighbour
+//  chunks and for heap inspection.
+//
+//  Pools attached by add() are linked into the same ring in address order.
+//  mcb.prev of the first MCB of every pool points to itself as well, so 
+//  chunks of different pools are never joined. Every pool is described by
+//  the region descriptor that holds pool attributes; descriptor of the 
+//  primary pool is a part of manager object, descriptors of attached pools
+//  are placed at the beginning of the pool memory. Regions are linked in
+//  attach order, that is the fallback order of attribute-driven allocation.
 //------------------------------------------------------------------------------
 
 
 #include <stdint.h>
 #include <stddef.h>
+#include <atomic>
 #include "heapcfg.h"
 
+// Cache line size used by ISOLATED allocations, can be redefined in heapcfg.h
+#ifndef HEAP_CACHE_LINE
+#define HEAP_CACHE_LINE 64
+#endif
+
+// Prefetch hint used by the chunk chain walk, can be redefined in heapcfg.h
+#ifndef HEAP_PREFETCH
+#if defined(__GNUC__)
+#define HEAP_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define HEAP_PREFETCH(addr) ((void)(addr))
+#endif
+#endif
+
+// Number of chunks the chain walk prefetches ahead, 0 - no prefetch.
+// The cursor ahead is a dependent walk itself, so the free list walk
+// does not get faster (see bench/scan.cpp). Can be redefined in heapcfg.h
+#ifndef HEAP_PREFETCH_AHEAD
+#define HEAP_PREFETCH_AHEAD 0
+#endif
+
 namespace heap 
 {
 
@@ -85,6 +126,25 @@ private:
     guard & gd;
 };
 
+//------------------------------------------------------------------------------
+// Guard for read-only access. If guard class provides lock_shared() and 
+// unlock_shared(), they are used, so that heap inspection does not serialize 
+// readers. Otherwise exclusive lock()/unlock() are called
+template <typename guard>
+class shared_scope_guard
+{
+public:
+    shared_scope_guard(guard& g): gd(g) { lock(gd, 0); }
+    ~shared_scope_guard() { unlock(gd, 0); }
+private:
+    template <typename g> static auto lock(g & x, int) -> decltype(x.lock_shared()) { x.lock_shared(); }
+    template <typename g> static void lock(g & x, long) { x.lock(); }
+    template <typename g> static auto unlock(g & x, int) -> decltype(x.unlock_shared()) { x.unlock_shared(); }
+    template <typename g> static void unlock(g & x, long) { x.unlock(); }
+
+    guard & gd;
+};
+
 //------------------------------------------------------------------------------
 template <size_t size_bytes>
 struct pool
@@ -97,23 +157,82 @@ template <typename guard>
 class manager
 {
 public:
+    //--------------------------------------------------------------------------
+    // Memory pool attributes. Attributes are assigned to the pool when it is
+    // passed to the heap and are used to select the pool for allocation
+    //--------------------------------------------------------------------------
+    enum attribute
+    {
+        HUGEPAGE   = 1 << 0,    // pool is backed by huge pages
+        NUMA_LOCAL = 1 << 1,    // pool belongs to local NUMA node
+        LOCKED     = 1 << 2,    // pool is locked in RAM (not pageable)
+        FAST       = 1 << 3,    // fast memory: TCM, CCM, on-chip SRAM, etc
+        USER_ATTR  = 1 << 8,    // the first attribute free for application use
+    };
+
+    //--------------------------------------------------------------------------
+    // Allocation flags
+    //--------------------------------------------------------------------------
+    enum flags
+    {
+        PREFER     = 1 << 0,    // use other pools if pools with required 
+                                // attributes are exhausted
+        ISOLATED   = 1 << 1,    // ASA occupies whole cache lines: it is aligned
+                                // and rounded to HEAP_CACHE_LINE, so neither MCBs
+                                // nor other allocations share its lines
+    };
+
     // Heap initialization
     template<size_t size_items>
-    manager(int (& pool)[size_items]);
+    manager(int (& pool)[size_items], unsigned attr = 0);
 
     template<size_t size_bytes>
-    manager(pool<size_bytes> & pool_obj);
+    manager(pool<size_bytes> & pool_obj, unsigned attr = 0);
 
-    manager(int * pool, int size_bytes);
+    manager(int * pool, size_t size_bytes, unsigned attr = 0);
 
-    // Attach separate memory pool to the heap
-    void add(void * pool, int size );
+    // Attach separate memory pool to the heap. Pool must be aligned to
+    // pointer size, pool memory also holds pool descriptor
+    void add(void * pool, size_t size, unsigned attr = 0 );
 
     // Allocate 'size' bytes of memory in heap pool and returns
     // the pointer to this memory. In case of lack of memory the
     // function returns NULL.
     void *malloc( size_t size );
 
+    // Allocate 'size' bytes in pools that have all 'attr' attributes. Pools
+    // are scanned in attach order. With PREFER flag in 'options' the rest
+    // of pools are used (in the same order) when the preferred ones are
+    // exhausted
+    void *malloc( size_t size, unsigned attr, unsigned options = 0 );
+
+    // The same as malloc() but does not wait for the guard: if the heap is 
+    // locked by another thread, the function returns NULL immediately. 
+    // Requires try_lock() member of guard class
+    void *try_malloc( size_t size );
+
+    // Allocate 'size' bytes with ASA aligned to 'align' (power of 2). The 
+    // leading part of free chunk is split off if it is needed to align ASA
+    void *malloc_aligned( size_t size, size_t align );
+
+    // Allocate 'size' bytes aligned to 'align' (power of 2) that are never 
+    // released. The block has no MCB: it is cut from the top end of the last
+    // free chunk of a pool, so the pool shrinks and the block never takes 
+    // part in heap scans. Pools are tried in attach order. Returns NULL if 
+    // no pool ends with free chunk large enough. Permanent blocks are not
+    // counted by info() and stats()
+    void *malloc_permanent( size_t size, size_t align = sizeof(int) );
+
+    // Grow allocated chunk 'ptr' in place so that it can hold 'size' bytes, 
+    // free chunk that follows it is joined and the excess is split off. 
+    // Returns false if the chunk can not be grown without relocation, the 
+    // chunk is left unchanged in that case
+    bool expand( void *ptr, size_t size );
+
+    // Number of bytes available in ASA of allocated chunk 'ptr', it is
+    // never less than the size requested from malloc()
+    size_t usable_size( void *ptr ) const;
+
     //--------------------------------------------------------------------------
     // Deallocates previously allocated memory that is pointed by 'ptr'. If the 
     // ponter 'ptr' contains address of memory that was not previously allocated 
@@ -121,6 +240,45 @@ public:
     // to raise an exception)
     void free( void *ptr );
 
+    //--------------------------------------------------------------------------
+    // Deallocates 'count' pointers from array 'ptrs' under single guard 
+    // acquisition. Each pointer is handled in the same way as by free()
+    void free_batch( void **ptrs, size_t count );
+
+    //--------------------------------------------------------------------------
+    // Deallocates memory from interrupt or signal handler where the guard 
+    // can not be taken. The function is lock-free: the chunk is only put 
+    // to the deferred queue, it is actually released by the next malloc(), 
+    // free() or free_batch() call. Only type of the chunk is checked here, 
+    // the pointer is validated when the queue is drained
+    void free_deferred( void *ptr );
+
+    //--------------------------------------------------------------------------
+    // Allocation request that waits for memory. Application fills 'size', 
+    // 'priority' and 'ready'; the waiter object must stay alive until 
+    // ready() is called or the request is cancelled
+    struct waiter
+    {
+        waiter   *next;
+        size_t    size;
+        unsigned  priority;                 // higher is served first, FIFO among equal
+        void     *ptr;                      // allocated memory
+        void    (*ready)( waiter *w );      // called outside the guard
+    };
+
+    // Allocate 'w->size' bytes. If memory is available and no request of
+    // the same or higher priority is queued, the pointer is returned at once
+    // and ready() is not called. Otherwise the request is queued and NULL is
+    // returned; any heap function that releases large enough chunk (free(), 
+    // free_batch(), or another function that releases chunks queued by 
+    // free_deferred()) allocates memory for the queued requests in order and
+    // calls their ready() after the guard is released
+    void *malloc_async( waiter *w );
+
+    // Remove queued request. Returns false if the request is not queued 
+    // (e.g. it has been served already)
+    bool cancel( waiter *w );
+
     //--------------------------------------------------------------------------
     // Info about count and sizes of free and allocated memory chunks
     //--------------------------------------------------------------------------
@@ -134,13 +292,129 @@ public:
         }
         Used, Free;
 
+        // Add counters of 'other', Block_max_size fields get the larger value
+        void merge(summary const & other);
+
     };
     summary info();
 
+    // Info about chunks of pools that have all 'attr' attributes
+    summary info(unsigned attr);
+
+    //--------------------------------------------------------------------------
+    // Walk through attached pools in attach (fallback) order. 'fn' is called 
+    // as fn(void *pool, unsigned attr, summary const & info) for every pool
+    template<typename visitor>
+    void walk_regions( visitor fn );
+
+    //--------------------------------------------------------------------------
+    // Walk through all memory chunks in address order. 'fn' is called as 
+    // fn(void *asa, size_t size, bool used) for every chunk, 'size' is the 
+    // chunk size including MCB. Heap is locked in shared mode during the walk,
+    // so 'fn' must not call heap functions
+    template<typename visitor>
+    void walk( visitor fn );
+
+    //--------------------------------------------------------------------------
+    // Lock-free variant of info(). Counters are maintained by every heap 
+    // operation and published to one of two buffers selected by sequence 
+    // number, so the function never waits for heap operation in progress 
+    // and never returns torn values. Block_max_size fields are not tracked
+    // and are returned as zero, use info() to get them
+    summary stats() const;
+
+    //--------------------------------------------------------------------------
+    // Accounting tags. Every allocated chunk carries a tag (0 for untagged
+    // allocations), usage of each tag is counted on malloc and free
+    static unsigned const TAGS = 16;
+
+    struct tag_usage
+    {
+        size_t Blocks;
+        size_t Size;           // bytes, MCBs included
+        size_t Soft_limit;     // 0 - no limit
+        size_t Hard_limit;     // 0 - no limit
+        size_t Soft_hits;      // allocations that exceeded soft limit
+    };
+
+    // Allocate 'size' bytes on behalf of 'tag'. Returns NULL if hard limit 
+    // of the tag would be exceeded; exceeding of soft limit is only counted
+    void *malloc_tagged( size_t size, unsigned tag );
+
+    // Set limits of 'tag', 0 means no limit
+    void quota( unsigned tag, size_t soft, size_t hard );
+
+    // Counters of 'tag', O(1)
+    tag_usage usage( unsigned tag );
+
+    // Break down allocated chunks by tag: 'Result' receives TAGS items
+    void info_tags( typename summary::info * Result );
+
+    //--------------------------------------------------------------------------
+    // Memory pressure. Level is derived from free bytes (Free.Size of stats())
+    // on every heap operation: it becomes CRITICAL at or below 'critical'
+    // watermark, LOW at or below 'low' one and returns to NORMAL only when
+    // free bytes reach 'high' watermark
+    enum pressure
+    {
+        MEMORY_NORMAL = 0,
+        MEMORY_LOW,
+        MEMORY_CRITICAL
+    };
+
+    // Called after the guard is released when the level is changed, so
+    // handler may free memory
+    typedef void (*pressure_fn)( manager & heap, pressure level, void *context );
+
+    // Called by failing malloc() outside the guard, must release memory
+    // and return number of released bytes, 0 stops retries
+    typedef size_t (*reclaim_fn)( manager & heap, size_t size, void *context );
+
+    static unsigned const PRESSURE_HANDLERS = 4;
+    static unsigned const RECLAIM_RETRIES   = 2;
+
+    // Set watermarks, critical <= low <= high is required. 'high' = 0
+    // disables level tracking
+    void watermarks( size_t low, size_t high, size_t critical );
+
+    // Register level change handler. Returns false if all slots are taken
+    bool on_pressure( pressure_fn fn, void *context );
+
+    // Remove level change handler registered with the same 'fn' and 'context'
+    void off_pressure( pressure_fn fn, void *context );
+
+    // Set reclaim function used by malloc(), malloc(size, attr, options) and
+    // malloc_tagged(): when allocation fails, 'fn' is called and allocation
+    // is retried up to RECLAIM_RETRIES times. 'fn' = 0 disables reclaim
+    void on_reclaim( reclaim_fn fn, void *context );
+
+    // Current pressure level
+    pressure level();
+
+    //--------------------------------------------------------------------------
+    // Register pools of the heap in page map 'map' (heap::page_map from 
+    // heap_pagemap.h) with owner 'this' and 'index', pools attached later by
+    // add() are registered as well. Only pages that lie entirely within a 
+    // pool are registered. free(), free_batch() and free_deferred() ignore
+    // pointers to pages registered by other owners without touching their 
+    // MCB. Must be called before the heap is used concurrently. Returns 
+    // false if the map has no memory for its nodes
+    template<typename map_type>
+    bool map_pages( map_type & map, unsigned index = 0 );
+
+    // Stop lookups in the page map registered by map_pages(), e.g. before
+    // the map is destroyed. Pages stay registered in the map. Must not be 
+    // called concurrently with other heap functions
+    void unmap_pages() { Map = 0; }
+
 private:
     // Scan through all free memory chunks to find out
     // the chunk which satisfy to required size
     static bool   const USE_FULL_SCAN = 1;
+
+    // The chain walk keeps a cursor PREFETCH_AHEAD chunks ahead and requests
+    // the chunk under the cursor, see HEAP_PREFETCH_AHEAD
+    static size_t const PREFETCH_AHEAD = HEAP_PREFETCH_AHEAD;
     static size_t const HEAP_ALIGN    = sizeof(int);
 
     // Memory Control Block (MCB)
@@ -154,8 +428,9 @@ private:
         };
         struct type_size
         {
-            size_t type:8;
-            size_t size:24;
+            size_t type:4;
+            size_t tag:4;      // accounting tag of allocated chunk
+            size_t size:sizeof(size_t) * 8 - 8;
         };
 
         mcb *next;         // pointer to the next MCB                                             
@@ -169,61 +444,230 @@ private:
                            // directly after the MCB          
 
         // split current memory chunk. Returns the pointer to new MCB
-        mcb * split(size_t size, mcb * start);
+        mcb * split(size_t size);
 
         // join current memory chunk with the next
-        void merge_with_next(mcb * start);
+        void merge_with_next();
+
+        // the first chunk of pool, never joined with previous one
+        bool head() const { return prev == this; }
+
+        // size of the leading part of the chunk to be split off
+        // to get ASA aligned to 'align'
+        size_t gap(size_t align);
 
         void * pool() { return this + 1; }
+
+        // links of free list, valid for free chunks only
+        mcb *& next_free() { return ((mcb **)pool())[0]; }
+        mcb *& prev_free() { return ((mcb **)pool())[1]; }
+    };
+
+    // The smallest free chunk: MCB and the room for free list links
+    static size_t const MIN_CHUNK = (sizeof(mcb) + 2*sizeof(void *) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+
+    // The largest request: chunk size must fit into MCB size field, and
+    // rounding of the request must not wrap around
+    static size_t const MAX_REQUEST = ~(size_t)0 >> 9;
+
+    // Number of chunks examined in each direction through the ring to find 
+    // free neighbour of freed chunk, the chunk is put to the list head if
+    // there is no free chunk in that range
+    static unsigned const NEAR_SCAN = 4;
+
+    // Memory pool descriptor
+    //--------------------------------------------------------------------------
+    struct region
+    {
+        region   *next;        // next pool in attach order
+        mcb      *first;       // the first MCB of pool
+        void     *limit;       // end of the last chunk of pool, permanent
+                               // blocks are located above
+        unsigned  attr;        // pool attributes
+    };
+
+    void init(mcb * pstart, size_t size_bytes, unsigned attr);
+
+    // Exclusive guard of heap functions that change free memory. Queued 
+    // waiters that fit into memory released while Guard is held (by the 
+    // function itself or by drained free_deferred() calls) are served 
+    // before Guard is released. Their ready() and handlers of pressure 
+    // level change are called after Guard is released
+    class pressure_scope
+    {
+    public:
+        pressure_scope(manager & m, bool locked = false): heap(m) { if( !locked ) heap.Guard.lock(); }
+        ~pressure_scope();
+    private:
+        manager & heap;
+    };
+
+    struct pressure_handler
+    {
+        pressure_fn  fn;
+        void        *context;
     };
 
-    void init(mcb * pstart, size_t size_bytes);
+    // malloc() body, must be called with Guard locked
+    void *allocate( size_t size, unsigned attr, unsigned options, unsigned tag = 0, size_t align = HEAP_ALIGN );
+
+    // allocate() under the guard with reclaim-and-retry on failure, must be
+    // called with Guard unlocked
+    void *allocate_reclaim( size_t size, unsigned attr, unsigned options, unsigned tag = 0, size_t align = HEAP_ALIGN );
+
+    // update pressure level from Stats, must be called with Guard locked
+    void track();
+
+    // Find free chunk for 'size' bytes (MCB included) with ASA aligned to 
+    // 'align'. If 'r' is not 0, only chunks of pool 'r' are examined
+    mcb *find( region const *r, size_t size, size_t align );
+
+    // Allocate 'size' bytes from free chunk 'tptr'
+    void take( mcb *tptr, size_t size );
+
+    // Put free chunk 'tptr' into free list next to the nearest free chunk 
+    // among NEAR_SCAN neighbours on each side, or at the list head
+    void insert( mcb *tptr );
+
+    // Link free chunk 'tptr' between 'prev' (or list head if 'prev' is 0)
+    // and 'next'
+    void link( mcb *tptr, mcb *prev, mcb *next );
+
+    // Remove free chunk 'tptr' from free list
+    void unlink( mcb *tptr );
+
+    // Add info about chunks of pool 'r' to 'Result'
+    static void collect( region const *r, summary & Result );
+
+    // expand() body, must be called with Guard locked
+    bool extend( void *ptr, size_t size );
+
+    // free() body, must be called with Guard locked
+    void release( void *ptr );
+
+    // Crosscheck that 'ptr' points to ASA of allocated chunk
+    bool allocated( void *ptr ) const;
+
+    // Page map functions bound by map_pages()
+    typedef bool   (*map_set_fn)( void *map, void const *begin, size_t size, manager *owner, unsigned index );
+    typedef void * (*map_get_fn)( void const *map, void const *ptr );
+
+    template<typename map_type>
+    static bool map_set( void *map, void const *begin, size_t size, manager *owner, unsigned index )
+    {
+        return ((map_type *)map)->set_within(begin, size, typename map_type::entry_type(owner, index));
+    }
+
+    template<typename map_type>
+    static void *map_get( void const *map, void const *ptr )
+    {
+        return ((map_type const *)map)->get(ptr).owner();
+    }
+
+    // 'ptr' is located on page that is registered by other owner
+    bool foreign( void *ptr ) const;
+
+    // release chunks queued by free_deferred(), must be called with Guard locked
+    void drain_deferred();
+
+    // allocate memory for queued waiters that fit into chunks released since
+    // the previous call, returns list of served waiters. Must be called with 
+    // Guard locked
+    waiter *serve();
+
+    // call ready() of served waiters, must be called with Guard unlocked
+    static void notify( waiter *w );
+
+    // copy Stats to Published and update pressure level, must be called
+    // with Guard locked
+    void publish();
+
     //--------------------------------------------------------------------------
     // Heap descriptors 
     //--------------------------------------------------------------------------
     mcb *start;            // heap begin pointer (points to the first MCB) 
                            
-    mcb *freemem;          // pointer to the first free MCB      
+    mcb *freemem;          // pointer to the first free MCB, head of free list      
                            
+    region Primary;        // descriptor of primary pool, head of pools list
+
     guard Guard;           // thread-safe support 
-                           
+
+    std::atomic<void *> Deferred;   // chunks released by free_deferred(), linked 
+                                    // through the first word of ASA
+
+    waiter *Waiters;                // queued allocation requests, by priority
+    size_t  Freed;                  // the largest chunk released since waiters were served
+
+    summary Stats;                  // running counters, updated with Guard locked
+
+    tag_usage Tags[TAGS];           // per-tag counters and limits, updated with Guard locked
+
+    size_t   Low_mark;              // pressure watermarks, free bytes
+    size_t   High_mark;
+    size_t   Critical_mark;
+    pressure Level;                 // current pressure level
+    pressure Reported;              // level passed to handlers last time
+    pressure_handler Handlers[PRESSURE_HANDLERS];
+    reclaim_fn Reclaim;
+    void      *Reclaim_context;
+
+    std::atomic<unsigned> Seq;      // number of publications, Published[Seq & 1] is current
+    std::atomic<size_t>   Published[2][4];   // Used.Blocks, Used.Size, Free.Blocks, Free.Size
+
+    void      *Map;                 // page map, 0 if pools are not registered
+    map_set_fn Map_set;
+    map_get_fn Map_get;
+    unsigned   Map_index;
 };
 
 //------------------------------------------------------------------------------
 template<typename guard>
 template<size_t size_items>
-manager<guard>::manager(int (& pool)[size_items])
+manager<guard>::manager(int (& pool)[size_items], unsigned attr)
     : start((mcb *)pool)
     , freemem((mcb *)pool)
     , Guard()
+    , Deferred(0)
+    , Waiters(0)
+    , Freed(0)
+    , Seq(0)
 {
-    init(start, sizeof(pool));
+    init(start, sizeof(pool), attr);
 }
 
 //------------------------------------------------------------------------------
 template<typename guard>
-manager<guard>::manager(int * pool, int size_bytes)
+manager<guard>::manager(int * pool, size_t size_bytes, unsigned attr)
     : start((mcb *)pool)
     , freemem((mcb *)pool)
     , Guard()
+    , Deferred(0)
+    , Waiters(0)
+    , Freed(0)
+    , Seq(0)
 {
-    init(start, size_bytes);
+    init(start, size_bytes, attr);
 }
 
 //------------------------------------------------------------------------------
 template<typename guard>
 template<size_t size_bytes>
-manager<guard>::manager(pool<size_bytes> & pool_obj)
+manager<guard>::manager(pool<size_bytes> & pool_obj, unsigned attr)
     : start((mcb *)pool_obj.Pool)
     , freemem((mcb *)pool_obj.Pool)
     , Guard()
+    , Deferred(0)
+    , Waiters(0)
+    , Freed(0)
+    , Seq(0)
 {
-    init(start, sizeof(pool_obj));
+    init(start, sizeof(pool_obj), attr);
 }
 
 //------------------------------------------------------------------------------
 template<typename guard>
-void manager<guard>::init(mcb * pstart, size_t size_bytes)
+void manager<guard>::init(mcb * pstart, size_t size_bytes, unsigned attr)
 {
     // Circular pattern 
     pstart->next = pstart;
@@ -237,13 +681,73 @@ void manager<guard>::init(mcb * pstart, size_t size_bytes)
     // Set memory chunk free
     pstart->ts.type = mcb::FREE;
 
+    // The only free chunk
+    pstart->next_free() = 0;
+    pstart->prev_free() = 0;
+
+    Primary.next  = 0;
+    Primary.first = pstart;
+    Primary.limit = (char *)pstart + pstart->ts.size;
+    Primary.attr  = attr;
+
+    for(unsigned i = 0; i < TAGS; ++i)
+    {
+        tag_usage Empty = { 0, 0, 0, 0, 0 };
+        Tags[i] = Empty;
+    }
+
+    Low_mark      = 0;
+    High_mark     = 0;               // level tracking is disabled
+    Critical_mark = 0;
+    Level         = MEMORY_NORMAL;
+    Reported      = MEMORY_NORMAL;
+    for(unsigned i = 0; i < PRESSURE_HANDLERS; ++i)
+    {
+        Handlers[i].fn      = 0;
+        Handlers[i].context = 0;
+    }
+    Reclaim         = 0;
+    Reclaim_context = 0;
+
+    Map       = 0;
+    Map_set   = 0;
+    Map_get   = 0;
+    Map_index = 0;
+
+    summary Initial =
+    {
+        { 0, 0, 0 },
+        { 1, 0, pstart->ts.size }
+    };
+    Stats = Initial;
+    publish();
+
     // After initialization, heap is one free memory chunk with 
     // ASA size = sizeof(heap) - sizeof(MCB)
 }
 
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::summary::merge(summary const & other)
+{
+    Used.Blocks += other.Used.Blocks;
+    Used.Size   += other.Used.Size;
+    Free.Blocks += other.Free.Blocks;
+    Free.Size   += other.Free.Size;
+    if( Used.Block_max_size < other.Used.Block_max_size )
+        Used.Block_max_size = other.Used.Block_max_size;
+    if( Free.Block_max_size < other.Free.Block_max_size )
+        Free.Block_max_size = other.Free.Block_max_size;
+}
 //------------------------------------------------------------------------------
 template<typename guard>
 typename manager<guard>::summary  manager<guard>::info()
+{
+    return info(0);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::summary  manager<guard>::info(unsigned attr)
 {
     summary Result =
     {
@@ -251,10 +755,30 @@ typename manager<guard>::summary  manager<guard>::info()
         { 0, 0, 0 }
     };
 
-    scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous access
-    mcb *pBlock = freemem;
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    for(region *r = &Primary; r; r = r->next)
+    {
+        if( (r->attr & attr) == attr )
+            collect(r, Result);
+    }
+    return Result;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::collect(region const *r, summary & Result)
+{
+    mcb *pBlock = r->first;
+    mcb *ahead  = pBlock;                   // prefetch cursor
+    for(size_t i = 0; i < PREFETCH_AHEAD; ++i)
+        ahead = ahead->next;
     do
     {
+        if( PREFETCH_AHEAD )
+        {
+            ahead = ahead->next;
+            HEAP_PREFETCH(ahead);
+        }
+
         typename summary::info * pInfo = pBlock->ts.type == mcb::FREE ? &Result.Free : &Result.Used;
         ++pInfo->Blocks;
         pInfo->Size += pBlock->ts.size;
@@ -262,21 +786,97 @@ typename manager<guard>::summary  manager<guard>::info()
             pInfo->Block_max_size = pBlock->ts.size;
         pBlock = pBlock->next;
     }
+    while( !pBlock->head() );              // up to the first chunk of the next pool
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+template<typename visitor>
+void manager<guard>::walk_regions( visitor fn )
+{
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    for(region *r = &Primary; r; r = r->next)
+    {
+        summary Result =
+        {
+            { 0, 0, 0 },
+            { 0, 0, 0 }
+        };
+        collect(r, Result);
+        fn((void *)r->first, r->attr, (summary const &)Result);
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+template<typename visitor>
+void manager<guard>::walk( visitor fn )
+{
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    mcb *pBlock = start;
+    do
+    {
+        fn(pBlock->pool(), (size_t)pBlock->ts.size, pBlock->ts.type != mcb::FREE);
+        pBlock = pBlock->next;
+    }
     while(pBlock != start);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::publish()
+{
+    // Counters are written to the buffer that readers do not use, then it 
+    // becomes current. The fence orders previous switch before the writes,
+    // so a reader that sees them sees the switch as well
+    unsigned seq = Seq.load(std::memory_order_relaxed);
+    std::atomic<size_t> *Buffer = Published[(seq + 1) & 1];
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Buffer[0].store(Stats.Used.Blocks, std::memory_order_relaxed);
+    Buffer[1].store(Stats.Used.Size,   std::memory_order_relaxed);
+    Buffer[2].store(Stats.Free.Blocks, std::memory_order_relaxed);
+    Buffer[3].store(Stats.Free.Size,   std::memory_order_relaxed);
+
+    Seq.store(seq + 1, std::memory_order_release);
+    track();
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::summary  manager<guard>::stats() const
+{
+    summary Result =
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 }
+    };
+
+    // Writer in progress fills the other buffer, so it is never waited for.
+    // Current buffer is rewritten only by the next publication after that,
+    // the read is retried if any publication has completed meanwhile
+    unsigned seq;
+    do
+    {
+        seq = Seq.load(std::memory_order_acquire);
+        std::atomic<size_t> const *Buffer = Published[seq & 1];
+        Result.Used.Blocks = Buffer[0].load(std::memory_order_relaxed);
+        Result.Used.Size   = Buffer[1].load(std::memory_order_relaxed);
+        Result.Free.Blocks = Buffer[2].load(std::memory_order_relaxed);
+        Result.Free.Size   = Buffer[3].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    while( seq != Seq.load(std::memory_order_relaxed) );
     return Result;
 }
 //------------------------------------------------------------------------------
 template<typename guard>
-void manager<guard>::mcb::merge_with_next(mcb * start)
+void manager<guard>::mcb::merge_with_next()
 {
     // Check Next MCB
     mcb* other = next;
     // Join current and next chunks
     ts.size = ts.size + other->ts.size;
     other = next = other->next;
-    // After joining chunks, if the next chunk is not the last 
-    // then set the chunk's mcb.prev to current chunk
-    if( other != start )
+    // After joining chunks, if the next chunk is not the first 
+    // in the pool then set the chunk's mcb.prev to current chunk
+    if( !other->head() )
         other->prev = this;
 
 }
@@ -284,82 +884,369 @@ void manager<guard>::mcb::merge_with_next(mcb * start)
 template<typename guard>
 void manager<guard>::free(void *pool )
 {
-    // All pointer values should be checked to hit in RAM, otherwise an exception can occur
-    
-    // Check pointer alignment
-    if( !pool || ((uintptr_t)pool & (HEAP_ALIGN - 1)))
+    // Check pointer alignment and owner of the page
+    if( !pool || ((uintptr_t)pool & (HEAP_ALIGN - 1)) || foreign(pool) )
         return;
 
-    mcb *xptr;
-    mcb *tptr = (mcb *)pool - 1;
+    pressure_scope ScopeGuard(*this);        // protect the following code from asyncronous access
+    drain_deferred();
+    release(pool);
+    publish();
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::free_batch(void **ptrs, size_t count )
+{
+    pressure_scope ScopeGuard(*this);        // protect the following code from asyncronous access
+    drain_deferred();
+    for(size_t i = 0; i < count; ++i)
+    {
+        // Check pointer alignment and owner of the page
+        if( ptrs[i] && !((uintptr_t)ptrs[i] & (HEAP_ALIGN - 1)) && !foreign(ptrs[i]) )
+            release(ptrs[i]);
+    }
+    publish();
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::free_deferred(void *pool )
+{
+    // Check pointer alignment and owner of the page
+    if( !pool || ((uintptr_t)pool & (HEAP_ALIGN - 1)) || foreign(pool) )
+        return;
 
-    scope_guard<guard> ScopeGuard(Guard);    // protect the following code from asyncronous access
-    
-    // Crosscheck for valid values
-    xptr = tptr->prev;
-    if( (xptr != tptr && xptr->next != tptr) || pool < start )
+    // The link overwrites ASA, so it is written to allocated chunks only: 
+    // ASA of free chunk holds free list links. Type of allocated chunk is
+    // changed by release of the chunk itself only, so it is read without 
+    // the guard, full crosscheck is done by drain_deferred()
+    if( ((mcb *)pool - 1)->ts.type != mcb::ALLOCATED )
+        return;
+
+    void *head = Deferred.load(std::memory_order_relaxed);
+    do
+    {
+        *(void **)pool = head;                // ASA is not used by application any more
+    }
+    while( !Deferred.compare_exchange_weak(head, pool,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed) );
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::drain_deferred()
+{
+    if( !Deferred.load(std::memory_order_relaxed) )
+        return;
+
+    void *pool = Deferred.exchange(0, std::memory_order_acquire);
+    while( pool )
+    {
+        // Chunk that does not pass the crosscheck was queued twice or 
+        // released by free() meanwhile, its link can not be trusted
+        if( !allocated(pool) )
+            break;
+
+        void *next = *(void **)pool;          // read link before the chunk is released
+        release(pool);
+        pool = next;
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::release(void *pool )
+{
+    // All pointer values should be checked to hit in RAM, otherwise an exception can occur
+    if( !allocated(pool) )
         return;
 
+    mcb *tptr = (mcb *)pool - 1;
+    mcb *xptr = tptr->prev;
+
     // Valid pointer present ------------------------------------------------
     tptr->ts.type = mcb::FREE;          // Mark as "free"
-    // Check Next MCB
-    xptr = tptr->next;
-    
+    --Stats.Used.Blocks;
+    Stats.Used.Size -= tptr->ts.size;
+    ++Stats.Free.Blocks;
+    Stats.Free.Size += tptr->ts.size;
+    --Tags[tptr->ts.tag].Blocks;
+    Tags[tptr->ts.tag].Size -= tptr->ts.size;
+
+    mcb *nptr = tptr->next;
+    bool next_free = nptr->ts.type == mcb::FREE && !nptr->head();
+    bool prev_free = xptr->ts.type == mcb::FREE && !tptr->head();
+
+    // Free list: previous free chunk absorbs current one and stays in the
+    // list, otherwise current chunk takes place of the next one or is 
+    // inserted next to the nearest free chunk
+    if( prev_free )
+    {
+        if( next_free )
+            unlink(nptr);
+    }
+    else if( next_free )
+    {
+        link(tptr, nptr->prev_free(), nptr->next_free());
+    }
+    else
+    {
+        insert(tptr);
+    }
+
     // If the next chunk is free and the chunk is not the first
-    // in the heap
-    if( xptr->ts.type == mcb::FREE && xptr != start )
+    // in the pool
+    if( next_free )
     {
-        // Join current (tptr) and next (xptr) chunks
-        tptr->merge_with_next(start);
+        // Join current (tptr) and next (nptr) chunks
+        tptr->merge_with_next();
+        --Stats.Free.Blocks;
     }
-    // Check previous MCB
-    xptr = tptr->prev;
     // If previous chunk is free and current chunk is not
-    // first in the heap...
-    if( xptr->ts.type == mcb::FREE && tptr != start )
+    // first in the pool...
+    if( prev_free )
     {
         // Join current (tptr) and previous (xptr) chunks
-        xptr->merge_with_next(start);
+        xptr->merge_with_next();
+        --Stats.Free.Blocks;
         tptr = xptr;            // tprt always point to freed chunk
     }
-    // Set heap->freem for more efficient search
-    if( tptr < freemem )        // Is freed chunk located berore the fisrt one that was considered free?
-        freemem = tptr;         // Update free chunk pointer
+    if( Freed < tptr->ts.size )
+        Freed = tptr->ts.size;
 }
 //------------------------------------------------------------------------------
 template<typename guard>
-void manager<guard>::add(void * pool, int size )
+bool manager<guard>::allocated( void *ptr ) const
 {
-    mcb *xptr = (mcb *)pool;
-    mcb *tptr = freemem;
-    
-    // Init MCB in new chunk
-    xptr->next = tptr;
-    xptr->prev = xptr;                   // the first mcb in pool always points to itself
-    xptr->ts.size = size - sizeof(mcb);
-    xptr->ts.type = mcb::FREE;
-    // Reinit Primary MCB
-    tptr->next = xptr;
+    if( ptr < start )
+        return false;
+
+    mcb *tptr = (mcb *)ptr - 1;
+    mcb *xptr = tptr->prev;
+    return (xptr == tptr || xptr->next == tptr) && tptr->ts.type == mcb::ALLOCATED;
 }
 //------------------------------------------------------------------------------
 template<typename guard>
-typename manager<guard>::mcb * manager<guard>::mcb::split(size_t size, manager<guard>::mcb * start)
+bool manager<guard>::foreign( void *ptr ) const
 {
-    uintptr_t new_mcb_addr = (uintptr_t)this + size;
-    mcb *new_mcb = (mcb *)new_mcb_addr;
-    new_mcb->next = next;
-    new_mcb->prev = this;
-    new_mcb->ts.size = ( ts.size - size );
-    new_mcb->ts.type = FREE;
+    if( !Map )
+        return false;
 
-    // Reinit current MCB
-    next = new_mcb;
-    ts.size = size;
-    ts.type = ALLOCATED;  // Mark block as used
+    void *owner = Map_get(Map, ptr);
+    return owner && owner != this;          // pages shared with other memory are not registered
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+template<typename map_type>
+bool manager<guard>::map_pages( map_type & map, unsigned index )
+{
+    Map       = &map;
+    Map_set   = &map_set<map_type>;
+    Map_get   = &map_get<map_type>;
+    Map_index = index;
+
+    bool Result = true;
+    for(region *r = &Primary; r; r = r->next)
+    {
+        if( !Map_set(Map, r->first, (char *)r->limit - (char *)r->first, this, Map_index) )
+            Result = false;
+    }
+    return Result;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::malloc_async( waiter *w )
+{
+    pressure_scope ScopeGuard(*this);       // protect the following code from asyncronous access
+
+    // Requests of the same or higher priority are queued already, the new 
+    // one has to wait behind them
+    void *Allocated = 0;
+    if( !Waiters || Waiters->priority < w->priority )
+        Allocated = allocate(w->size, 0, 0);
+    w->ptr = Allocated;
+    if( !Allocated )
+    {
+        waiter **pp = &Waiters;
+        while( *pp && (*pp)->priority >= w->priority )
+            pp = &(*pp)->next;
+        w->next = *pp;
+        *pp = w;
+    }
+    return Allocated;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+bool manager<guard>::cancel( waiter *w )
+{
+    bool Found = false;
+    pressure_scope ScopeGuard(*this);       // protect the following code from asyncronous access
+    for(waiter **pp = &Waiters; *pp; pp = &(*pp)->next)
+    {
+        if( *pp == w )
+        {
+            *pp   = w->next;
+            Found = true;
+            break;
+        }
+    }
+    Freed = ~(size_t)0;                     // requests behind the removed one may fit now
+    return Found;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::waiter * manager<guard>::serve()
+{
+    waiter  *Served = 0;
+    waiter **tail   = &Served;
+    while( Waiters && Freed >= Waiters->size + sizeof(mcb) )
+    {
+        void *Allocated = allocate(Waiters->size, 0, 0);
+        if( !Allocated )
+            break;
+        waiter *w = Waiters;
+        Waiters   = w->next;
+        w->ptr    = Allocated;
+        w->next   = 0;
+        *tail     = w;
+        tail      = &w->next;
+    }
+    Freed = 0;
+    return Served;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::notify( waiter *w )
+{
+    while( w )
+    {
+        waiter *next = w->next;             // waiter may be reused by ready()
+        w->ready(w);
+        w = next;
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::insert( mcb *tptr )
+{
+    // Neighbours of the chunk up to the pool boundaries. Free chunk found 
+    // below gets the chunk after itself, free chunk found above - before
+    mcb *bptr = tptr;
+    mcb *aptr = tptr;
+    for(unsigned i = 0; i < NEAR_SCAN; ++i)
+    {
+        if( !bptr->head() )
+        {
+            bptr = bptr->prev;
+            if( bptr->ts.type == mcb::FREE )
+            {
+                link(tptr, bptr, bptr->next_free());
+                return;
+            }
+        }
+        if( !aptr->next->head() )
+        {
+            aptr = aptr->next;
+            if( aptr->ts.type == mcb::FREE )
+            {
+                link(tptr, aptr->prev_free(), aptr);
+                return;
+            }
+        }
+    }
+    link(tptr, 0, freemem);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::link( mcb *tptr, mcb *prev, mcb *next )
+{
+    tptr->prev_free() = prev;
+    tptr->next_free() = next;
+    (prev ? prev->next_free() : freemem) = tptr;
+    if( next )
+        next->prev_free() = tptr;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::unlink( mcb *tptr )
+{
+    mcb *prev = tptr->prev_free();
+    mcb *next = tptr->next_free();
+    (prev ? prev->next_free() : freemem) = next;
+    if( next )
+        next->prev_free() = prev;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::add(void * pool, size_t size, unsigned attr )
+{
+    region *r    = (region *)pool;
+    mcb    *xptr = (mcb *)(r + 1);
+
+    // Init MCB in new chunk
+    xptr->prev = xptr;                   // the first mcb in pool always points to itself
+    xptr->ts.size = size - sizeof(region) - sizeof(mcb);
+    xptr->ts.type = mcb::FREE;
+
+    r->first = xptr;
+    r->limit = (char *)xptr + xptr->ts.size;
+    r->attr  = attr;
+    r->next  = 0;
+
+    // Pages are registered before the pool is used, the map may take its 
+    // nodes from this heap
+    if( Map )
+        Map_set(Map, xptr, xptr->ts.size, this, Map_index);
+
+    pressure_scope ScopeGuard(*this);        // protect the following code from asyncronous access
+
+    // Append pool descriptor to the list
+    region *last = &Primary;
+    while( last->next )
+        last = last->next;
+    last->next = r;
+
+    // Link the chunk into the ring keeping address order
+    mcb *tptr = start;
+    if( xptr < start )                   // new pool is located below the heap begin
+    {
+        while( tptr->next != start )     // find the last chunk of the heap
+            tptr = tptr->next;
+        xptr->next = start;
+        tptr->next = xptr;
+        start      = xptr;
+    }
+    else
+    {
+        while( tptr->next != start && tptr->next < xptr )   // find the last chunk 
+            tptr = tptr->next;                              // below the new pool
+        xptr->next = tptr->next;
+        tptr->next = xptr;
+    }
+    // Insert the chunk into free list
+    insert(xptr);
+
+    ++Stats.Free.Blocks;
+    Stats.Free.Size += xptr->ts.size;
+    publish();
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::mcb * manager<guard>::mcb::split(size_t size)
+{
+    uintptr_t new_mcb_addr = (uintptr_t)this + size;
+    mcb *new_mcb = (mcb *)new_mcb_addr;
+    new_mcb->next = next;
+    new_mcb->prev = this;
+    new_mcb->ts.size = ( ts.size - size );
+    new_mcb->ts.type = FREE;
+
+    // Reinit current MCB
+    next = new_mcb;
+    ts.size = size;
+    ts.type = ALLOCATED;  // Mark block as used
 
-    // If the next MCB is not last then mcb.prev of the following MCB
-    // must point to allocated (xptf) MCB
-    if( new_mcb->next != start )
+    // If the next MCB is not the first in the pool then mcb.prev of the 
+    // following MCB must point to new MCB
+    if( !new_mcb->next->head() )
         ( new_mcb->next )->prev = new_mcb;
     return new_mcb;
 }
@@ -368,79 +1255,471 @@ typename manager<guard>::mcb * manager<guard>::mcb::split(size_t size, manager<g
 template<typename guard>
 void * manager<guard>::malloc( size_t size )
 {
+    return allocate_reclaim(size, 0, 0);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::malloc( size_t size, unsigned attr, unsigned options )
+{
+    return allocate_reclaim(size, attr, options);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::malloc_aligned( size_t size, size_t align )
+{
+    if( align < HEAP_ALIGN )
+        align = HEAP_ALIGN;
+
+    return allocate_reclaim(size, 0, 0, 0, align);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::try_malloc( size_t size )
+{
+    if( !Guard.try_lock() )                 // heap is busy
+        return 0;
+
+    pressure_scope ScopeGuard(*this, true); // the guard is taken already
+    return allocate(size, 0, 0);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::malloc_tagged( size_t size, unsigned tag )
+{
+    if( tag >= TAGS )
+        return 0;
+
+    return allocate_reclaim(size, 0, 0, tag);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::quota( unsigned tag, size_t soft, size_t hard )
+{
+    if( tag >= TAGS )
+        return;
+
+    scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous access
+    Tags[tag].Soft_limit = soft;
+    Tags[tag].Hard_limit = hard;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::tag_usage manager<guard>::usage( unsigned tag )
+{
+    tag_usage Result = { 0, 0, 0, 0, 0 };
+    if( tag >= TAGS )
+        return Result;
+
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    return Tags[tag];
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::info_tags( typename summary::info * Result )
+{
+    for(unsigned i = 0; i < TAGS; ++i)
+    {
+        Result[i].Blocks         = 0;
+        Result[i].Block_max_size = 0;
+        Result[i].Size           = 0;
+    }
+
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    mcb *pBlock = start;
+    do
+    {
+        if( pBlock->ts.type == mcb::ALLOCATED )
+        {
+            typename summary::info * pInfo = &Result[pBlock->ts.tag];
+            ++pInfo->Blocks;
+            pInfo->Size += pBlock->ts.size;
+            if(pInfo->Block_max_size < pBlock->ts.size)
+                pInfo->Block_max_size = pBlock->ts.size;
+        }
+        pBlock = pBlock->next;
+    }
+    while( pBlock != start );
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::allocate_reclaim( size_t size, unsigned attr, unsigned options, unsigned tag, size_t align )
+{
+    for(unsigned attempt = 0; ; ++attempt)
+    {
+        reclaim_fn fn;
+        void      *context;
+        {
+            pressure_scope ScopeGuard(*this);    // protect the following code from asyncronous access
+            void *Allocated = allocate(size, attr, options, tag, align);
+            if( Allocated || !Reclaim || attempt == RECLAIM_RETRIES )
+                return Allocated;
+            fn      = Reclaim;
+            context = Reclaim_context;
+        }
+        if( !fn(*this, size, context) )      // nothing is released, retry is useless
+            return 0;
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::track()
+{
+    if( !High_mark )
+        return;
+
+    size_t Free = Stats.Free.Size;
+    if( Free <= Critical_mark )
+        Level = MEMORY_CRITICAL;
+    else if( Free <= Low_mark )
+        Level = MEMORY_LOW;
+    else if( Free >= High_mark )
+        Level = MEMORY_NORMAL;
+    else if( Level == MEMORY_CRITICAL )     // between low and high watermarks
+        Level = MEMORY_LOW;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+manager<guard>::pressure_scope::~pressure_scope()
+{
+    waiter          *Served  = heap.Waiters && heap.Freed ? heap.serve() : 0;
+    pressure_handler Called[PRESSURE_HANDLERS];
+    pressure         Changed = heap.Level;
+    bool             Notify  = Changed != heap.Reported;
+    if( Notify )
+    {
+        // handlers may be removed by other threads once the guard is released
+        heap.Reported = Changed;
+        for(unsigned i = 0; i < PRESSURE_HANDLERS; ++i)
+            Called[i] = heap.Handlers[i];
+    }
+    heap.Guard.unlock();
+
+    notify(Served);
+    if( Notify )
+    {
+        for(unsigned i = 0; i < PRESSURE_HANDLERS; ++i)
+        {
+            if( Called[i].fn )
+                Called[i].fn(heap, Changed, Called[i].context);
+        }
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::watermarks( size_t low, size_t high, size_t critical )
+{
+    pressure_scope ScopeGuard(*this);       // protect the following code from asyncronous access
+    Low_mark      = low;
+    High_mark     = high;
+    Critical_mark = critical;
+    Level         = MEMORY_NORMAL;
+    track();
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+bool manager<guard>::on_pressure( pressure_fn fn, void *context )
+{
+    scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous access
+    for(unsigned i = 0; i < PRESSURE_HANDLERS; ++i)
+    {
+        if( !Handlers[i].fn )
+        {
+            Handlers[i].fn      = fn;
+            Handlers[i].context = context;
+            return true;
+        }
+    }
+    return false;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::off_pressure( pressure_fn fn, void *context )
+{
+    scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous access
+    for(unsigned i = 0; i < PRESSURE_HANDLERS; ++i)
+    {
+        if( Handlers[i].fn == fn && Handlers[i].context == context )
+        {
+            Handlers[i].fn      = 0;
+            Handlers[i].context = 0;
+        }
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::on_reclaim( reclaim_fn fn, void *context )
+{
+    scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous access
+    Reclaim         = fn;
+    Reclaim_context = context;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::pressure manager<guard>::level()
+{
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    return Level;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::malloc_permanent( size_t size, size_t align )
+{
+    if( align < HEAP_ALIGN )
+        align = HEAP_ALIGN;
+
+    pressure_scope ScopeGuard(*this);       // protect the following code from asyncronous access
+    drain_deferred();
+
+    void *Allocated = 0;                    // No Memory
+    for(region *r = &Primary; r && !Allocated; r = r->next)
+    {
+        // The last free chunk of the pool
+        mcb *tptr = 0;
+        for(mcb *fptr = freemem; fptr && !tptr; fptr = fptr->next_free())
+        {
+            if( (char *)fptr + fptr->ts.size == r->limit )
+                tptr = fptr;
+        }
+        if( !tptr )                         // pool ends with allocated chunk
+            continue;
+
+        uintptr_t top = ((uintptr_t)r->limit - size) & ~(uintptr_t)(align - 1);
+        if( size > (uintptr_t)r->limit - (uintptr_t)tptr || top < (uintptr_t)tptr + MIN_CHUNK )
+            continue;                       // the chunk must stay large enough to be free chunk
+
+        Stats.Free.Size -= (uintptr_t)r->limit - top;
+        tptr->ts.size = top - (uintptr_t)tptr;
+        r->limit  = (void *)top;
+        Allocated = (void *)top;
+    }
+    publish();
+    return Allocated;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+bool manager<guard>::expand( void *ptr, size_t size )
+{
+    // Check pointer alignment
+    if( !ptr || ((uintptr_t)ptr & (HEAP_ALIGN - 1)))
+        return false;
+
+    pressure_scope ScopeGuard(*this);       // protect the following code from asyncronous access
+    drain_deferred();
+    bool Expanded = extend(ptr, size);
+    publish();
+    return Expanded;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+bool manager<guard>::extend( void *ptr, size_t size )
+{
+    if( size > MAX_REQUEST )
+        return false;
+
     // add mcb size and round up to HEAP_ALIGN
     size = (size + sizeof(mcb) + ( HEAP_ALIGN - 1 )) & ~( HEAP_ALIGN - 1 );
 
-    mcb *xptr;
-    if(USE_FULL_SCAN)
-        xptr = 0;
+    // Crosscheck for valid values
+    if( !allocated(ptr) )
+        return false;
 
-    void *Allocated;
-    size_t free_cnt = 0;
+    mcb *tptr = (mcb *)ptr - 1;
 
-    scope_guard<guard> ScopeGuard(Guard);                             // protect the following code from asyncronous access
-    mcb *tptr = freemem;                                              // Scan begins from the first free MCB
-    for(;;)
+    if( tptr->ts.size >= size )             // already large enough
+        return true;
+
+    mcb *xptr = tptr->next;
+    if( xptr->ts.type != mcb::FREE || xptr->head() || tptr->ts.size + xptr->ts.size < size )
+        return false;
+
+    // Hard limit of the tag applies to the grown chunk
+    tag_usage & Tag = Tags[tptr->ts.tag];
+    size_t joined = tptr->ts.size + xptr->ts.size;
+    size_t grown  = joined >= size + MIN_CHUNK ? size : joined;
+    if( Tag.Hard_limit && Tag.Size - tptr->ts.size + grown > Tag.Hard_limit )
+        return false;
+    Tag.Size += grown - tptr->ts.size;
+
+    // Join the next chunk, it leaves free list
+    mcb *prev = xptr->prev_free();
+    mcb *next = xptr->next_free();
+    unlink(xptr);
+    --Stats.Free.Blocks;
+    Stats.Free.Size -= xptr->ts.size;
+    Stats.Used.Size += xptr->ts.size;
+    tptr->merge_with_next();
+
+    // Return the excess to free list in place of joined chunk
+    if( tptr->ts.size >= size + MIN_CHUNK )
+    {
+        xptr = tptr->split(size);
+        link(xptr, prev, next);
+        ++Stats.Free.Blocks;
+        Stats.Free.Size += xptr->ts.size;
+        Stats.Used.Size -= xptr->ts.size;
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+size_t manager<guard>::usable_size( void *ptr ) const
+{
+    return ((mcb *)ptr - 1)->ts.size - sizeof(mcb);
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+size_t manager<guard>::mcb::gap(size_t align)
+{
+    if( align <= HEAP_ALIGN )
+        return 0;
+
+    size_t lead = (0 - (uintptr_t)pool()) & (align - 1);
+    while( lead && lead < MIN_CHUNK )       // leading part must be able to form free chunk
+        lead += align;
+    return lead;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+typename manager<guard>::mcb * manager<guard>::find( region const *r, size_t size, size_t align )
+{
+    mcb *xptr  = 0;                                                   // the first chunk large enough to be split
+    mcb *ahead = freemem;                                             // prefetch cursor
+    for(size_t i = 0; i < PREFETCH_AHEAD && ahead; ++i)
+        ahead = ahead->next_free();
+
+    for(mcb *tptr = freemem; tptr; tptr = tptr->next_free())
     {
-        if( tptr->ts.type == mcb::FREE )
+        if( PREFETCH_AHEAD && ahead )
         {
-            if( !USE_FULL_SCAN )
-                ++free_cnt;
-            if( tptr->ts.size >= size                                 // Current free ASA size is equal to required size or
-                 && tptr->ts.size <= size + sizeof(mcb) + HEAP_ALIGN) // current free ASA size is greater then required size
+            ahead = ahead->next_free();
+            HEAP_PREFETCH(ahead);
+        }
+
+        if( r && (tptr < r->first || tptr >= r->limit) )              // chunk of other pool
+            continue;
+
+        size_t need = size + tptr->gap(align);                        // leading part is split off for aligned ASA
+        if( tptr->ts.size >= need                                     // Current free ASA size is equal to required size or
+             && tptr->ts.size < need + MIN_CHUNK)                     // current free ASA size is greater then required size
                                                                       // and the rest (after splitting) of current chunk
-                                                                      // is large enough to allocate MCB + one allocation unit.
-            {
-                tptr->ts.type = mcb::ALLOCATED;                       // Allocate the chunk
-                Allocated = tptr->pool();
-                if( USE_FULL_SCAN )
-                    ++free_cnt;
+                                                                      // is too small to form free chunk.
+        {
+            return tptr;
+        }
+        if( !xptr && tptr->ts.size >= need )                          // Is memory chunk large enough to allocate MCB and 
+        {                                                             // required ammount of memory as ASA?
+            xptr  = tptr;
+            if( !USE_FULL_SCAN )
                 break;
-            }
-            else
-            {
-                if( USE_FULL_SCAN )
-                {
-                    if( xptr == NULL )
-                    {
-                        if( tptr->ts.size >= size)                    // Is memory chunk large enough to allocate MCB and 
-                            xptr = tptr;                              // required ammount of memory as ASA?
-                        ++free_cnt;
-                    }
-                }
-                else if( tptr->ts.size >= size )                      // Is memory chunk large enough to allocate MCB and   
-                {                                                     // required ammount of memory as ASA?                 
-                    // Create new free MCB in parent's MCB tail
-                    xptr = tptr->split(size, start);
-                    Allocated = tptr->pool();
-                    break;
-                }
-            }
         }
+    }
+    return xptr;
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void manager<guard>::take( mcb *tptr, size_t size )
+{
+    if( tptr->ts.size < size + MIN_CHUNK )                            // The rest is too small to be a chunk
+    {
+        tptr->ts.type = mcb::ALLOCATED;                               // Allocate the chunk
+        unlink(tptr);
+        --Stats.Free.Blocks;
+        Stats.Free.Size -= tptr->ts.size;
+        ++Stats.Used.Blocks;
+        Stats.Used.Size += tptr->ts.size;
+    }
+    else
+    {
+        // Create new free MCB in parent's MCB tail, it takes place 
+        // of the parent in free list
+        mcb *prev = tptr->prev_free();
+        mcb *next = tptr->next_free();
+        mcb *xptr = tptr->split(size);
+        link(xptr, prev, next);
+        Stats.Free.Size -= size;
+        ++Stats.Used.Blocks;
+        Stats.Used.Size += size;
+    }
+}
+//------------------------------------------------------------------------------
+template<typename guard>
+void * manager<guard>::allocate( size_t size, unsigned attr, unsigned options, unsigned tag, size_t align )
+{
+    if( size > MAX_REQUEST )
+        return 0;
+
+    // ASA must be able to hold free list links when the chunk is released
+    if( size < 2*sizeof(void *) )
+        size = 2*sizeof(void *);
 
-        tptr = tptr->next;                                            // Get ptr to next MCB
-        if( tptr == start )                                           // End of heap?
+    if( options & ISOLATED )
+    {
+        // ASA begins and ends at cache line boundary
+        size  = (size + HEAP_CACHE_LINE - 1) & ~(size_t)(HEAP_CACHE_LINE - 1);
+        align = HEAP_CACHE_LINE;
+    }
+
+    // add mcb size and round up to HEAP_ALIGN
+    size = (size + sizeof(mcb) + ( HEAP_ALIGN - 1 )) & ~( HEAP_ALIGN - 1 );
+
+    // chunk size multiple of 'align' keeps ASA of the following chunk 
+    // aligned, so that adjacent aligned allocations need no leading parts
+    if( align > HEAP_ALIGN && !(options & ISOLATED) )
+        size = (size + align - 1) & ~(align - 1);
+
+    drain_deferred();
+
+    tag_usage & Tag = Tags[tag];
+    if( Tag.Hard_limit && Tag.Size + size > Tag.Hard_limit )
+    {
+        publish();
+        return 0;                                                     // Quota exceeded
+    }
+
+    mcb *tptr;
+    if( !attr )
+    {
+        tptr = find(0, size, align);                                  // Scan begins from the first free MCB
+    }
+    else
+    {
+        // Pools with required attributes, then, if allowed, the rest of pools
+        tptr = 0;
+        for(region *r = &Primary; r && !tptr; r = r->next)
         {
-            if( USE_FULL_SCAN && xptr != 0 )
-            {
-                tptr = xptr;
-                // Create new free MCB in parent's MCB tail
-                xptr = tptr->split(size, start);
-                Allocated = tptr->pool();
-                break;
-            }
-            else
-            {
-                Allocated = 0;                                        // No Memory
-                break;
-            }
+            if( (r->attr & attr) == attr )
+                tptr = find(r, size, align);
+        }
+        for(region *r = &Primary; r && !tptr && (options & PREFER); r = r->next)
+        {
+            if( (r->attr & attr) != attr )
+                tptr = find(r, size, align);
         }
     }
 
-    if( ( free_cnt == 1 )&&( Allocated ) )          // Is the first free chunk has been allocated?
-        freemem = tptr->next;                       // Set 'first free chunk pointer' to the MCB of the next chunk
-                                                    // because either the chunk is free or, at least, it is closer to
-                                                    // the next free chunk
+    void *Allocated = 0;                                              // No Memory
+    if( tptr )
+    {
+        size_t lead = tptr->gap(align);
+        if( lead )
+        {
+            // Split off leading part, it stays free and is followed 
+            // by the rest in free list
+            mcb *xptr = tptr->split(lead);
+            tptr->ts.type = mcb::FREE;
+            link(xptr, tptr, tptr->next_free());
+            ++Stats.Free.Blocks;
+            tptr = xptr;
+        }
+        take(tptr, size);
+        tptr->ts.tag = tag;
+        ++Tag.Blocks;
+        Tag.Size += tptr->ts.size;
+        if( Tag.Soft_limit && Tag.Size > Tag.Soft_limit )
+            ++Tag.Soft_hits;
+        Allocated = tptr->pool();
+    }
+    publish();
     return Allocated;
 }
 //------------------------------------------------------------------------------
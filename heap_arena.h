@@ -0,0 +1,275 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Set of independently guarded heap arenas
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_ARENA_H__
+#define HEAP_ARENA_H__
+
+//------------------------------------------------------------------------------
+//  Arena Set
+//  ~~~~~~~~~
+//
+//    Memory pool is split into 'arena_count' equal parts, each part is
+//    controlled by its own heap manager with its own guard:
+//
+//    +-----------+-----------+-...-+-----------+
+//    |  arena 0  |  arena 1  |     |  arena N  |
+//    +-----------+-----------+-...-+-----------+
+//
+//    Thread is bound to the home arena on its first allocation (round
+//    robin). Bindings are kept per arena set in a small thread-local table,
+//    a thread that uses more than BINDINGS sets is bound anew to the sets
+//    whose bindings were dropped. Depending on selection mode, allocation 
+//    either waits for the home arena guard or tries the guards of the 
+//    arenas one by one starting from the home one and allocates from the 
+//    first arena that is not locked. Thread can be rebound to the arena 
+//    where allocation succeeded. If all arenas are busy or exhausted, the
+//    arenas are tried again with waiting.
+//
+//    Owner arena of a pointer is calculated from its address, so free()
+//    always returns the chunk to the arena it was allocated from. If the
+//    arenas are registered in a page map by map_pages(), arena free() also
+//    rejects pointers to pages of other heaps by map lookup.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <atomic>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+class arena_set
+{
+public:
+    enum select_mode
+    {
+        WAIT = 0,           // wait for home arena
+        TRY_NEXT,           // try_lock() arenas starting from home one
+        TRY_NEXT_REBIND,    // the same, thread is rebound to the arena that succeeded
+    };
+
+    template<size_t size_bytes>
+    arena_set(pool<size_bytes> & pool_obj, select_mode mode = TRY_NEXT_REBIND);
+
+    arena_set(int * pool, size_t size_bytes, select_mode mode = TRY_NEXT_REBIND);
+
+    ~arena_set();
+
+    void *malloc( size_t size );
+    void  free( void *ptr );
+
+    // Sum of info() of all arenas
+    typename manager<guard>::summary info();
+
+    // Register pages of all arenas in page map 'map' with arena number as
+    // index, see manager::map_pages()
+    template<typename map_type>
+    bool map_pages( map_type & map );
+
+    manager<guard> & arena(size_t index) { return *(manager<guard> *)Arenas[index]; }
+
+private:
+    static size_t const NONE     = ~(size_t)0;
+    static size_t const BINDINGS = 4;          // number of sets with remembered home arena
+
+    struct binding
+    {
+        size_t Set;                            // id of the set, 0 - empty slot
+        size_t Home;                           // home arena of the thread
+    };
+
+    void      init(int * pool, size_t size_bytes);
+    binding & bind();                          // binding of calling thread to this set
+    size_t    owner(void *ptr) const;
+
+    static thread_local binding Bindings[BINDINGS];
+    static std::atomic<size_t>  Sets;          // id counter
+
+    size_t const          Id;                  // id of the set
+    select_mode           Mode;
+    uintptr_t             Begin;               // pool address
+    size_t                Part;                // arena size, bytes
+    std::atomic<size_t>   Next;                // round robin binding counter
+
+    alignas(manager<guard>) unsigned char Arenas[arena_count][sizeof(manager<guard>)];
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+thread_local typename arena_set<guard, arena_count>::binding arena_set<guard, arena_count>::Bindings[BINDINGS];
+
+template <typename guard, size_t arena_count>
+std::atomic<size_t> arena_set<guard, arena_count>::Sets(0);
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+template<size_t size_bytes>
+arena_set<guard, arena_count>::arena_set(pool<size_bytes> & pool_obj, select_mode mode)
+    : Id(Sets.fetch_add(1, std::memory_order_relaxed) + 1)
+    , Mode(mode)
+    , Next(0)
+{
+    init(pool_obj.Pool, sizeof(pool_obj));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+arena_set<guard, arena_count>::arena_set(int * pool, size_t size_bytes, select_mode mode)
+    : Id(Sets.fetch_add(1, std::memory_order_relaxed) + 1)
+    , Mode(mode)
+    , Next(0)
+{
+    init(pool, size_bytes);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+arena_set<guard, arena_count>::~arena_set()
+{
+    for(size_t i = 0; i < arena_count; ++i)
+        arena(i).~manager<guard>();
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+void arena_set<guard, arena_count>::init(int * pool, size_t size_bytes)
+{
+    Begin = (uintptr_t)pool;
+    Part  = (size_bytes / arena_count) & ~(sizeof(int) - 1);
+    for(size_t i = 0; i < arena_count; ++i)
+        new (Arenas[i]) manager<guard>((int *)(Begin + i * Part), Part);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+typename arena_set<guard, arena_count>::binding & arena_set<guard, arena_count>::bind()
+{
+    for(size_t i = 0; i < BINDINGS; ++i)
+    {
+        if( Bindings[i].Set == Id )
+            return Bindings[i];
+    }
+
+    // The oldest binding is dropped
+    for(size_t i = BINDINGS - 1; i; --i)
+        Bindings[i] = Bindings[i - 1];
+    Bindings[0].Set  = Id;
+    Bindings[0].Home = Next.fetch_add(1, std::memory_order_relaxed) % arena_count;
+    return Bindings[0];
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+size_t arena_set<guard, arena_count>::owner(void *ptr) const
+{
+    uintptr_t offset = (uintptr_t)ptr - Begin;
+    return offset < Part * arena_count ? offset / Part : NONE;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+void * arena_set<guard, arena_count>::malloc( size_t size )
+{
+    binding & Binding = bind();
+    size_t    first   = Binding.Home;
+
+    if( Mode != WAIT )
+    {
+        for(size_t i = 0; i < arena_count; ++i)
+        {
+            size_t index = (first + i) % arena_count;
+            void *Allocated = arena(index).try_malloc(size);
+            if( Allocated )
+            {
+                if( Mode == TRY_NEXT_REBIND )
+                    Binding.Home = index;
+                return Allocated;
+            }
+        }
+    }
+
+    // All arenas are busy or exhausted - wait for them in turn
+    for(size_t i = 0; i < arena_count; ++i)
+    {
+        void *Allocated = arena((first + i) % arena_count).malloc(size);
+        if( Allocated )
+            return Allocated;
+    }
+    return 0;                                   // No Memory
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+void arena_set<guard, arena_count>::free( void *ptr )
+{
+    size_t index = owner(ptr);
+    if( index != NONE )
+        arena(index).free(ptr);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+template<typename map_type>
+bool arena_set<guard, arena_count>::map_pages( map_type & map )
+{
+    bool Result = true;
+    for(size_t i = 0; i < arena_count; ++i)
+    {
+        if( !arena(i).map_pages(map, (unsigned)i) )
+            Result = false;
+    }
+    return Result;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t arena_count>
+typename manager<guard>::summary arena_set<guard, arena_count>::info()
+{
+    typename manager<guard>::summary Result =
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 }
+    };
+
+    for(size_t i = 0; i < arena_count; ++i)
+        Result.merge(arena(i).info());
+    return Result;
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_ARENA_H__
+
@@ -0,0 +1,720 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Bitmap heap manager for fixed-granularity pools
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_BITMAP_H__
+#define HEAP_BITMAP_H__
+
+//------------------------------------------------------------------------------
+//  Bitmap Heap Structure
+//  ~~~~~~~~~~~~~~~~~~~~~
+//
+//    Pool is divided into two bitmaps and the data area of N units of
+//    'granule' bytes:
+//
+//    +------+------+----+----+----+----+-------+-----+--------+-...-+--------+
+//    | Used | Last | L1 | L2 | R1 | R2 | State | pad | unit 0 |     | unit N |
+//    +------+------+----+----+----+----+-------+-----+--------+-...-+--------+
+//
+//    Used bit is set for every unit of an allocated chunk, Last bit is set
+//    for the last unit of an allocated chunk. Chunk size is never stored,
+//    free() finds the end of the chunk by the Last bitmap.
+//
+//    Free run is searched one machine word at a time: the first zero bit of
+//    the Used bitmap is the run start, the next set bit is the run end, both
+//    are found by count-trailing-zeros instruction.
+//
+//    Fully allocated words are skipped by the summary bitmaps: bit of L1 is
+//    set when the corresponding word of Used bitmap is full, bit of L2 is
+//    set when the corresponding word of L1 is full. The search for the next
+//    word with free space reads at most one L1 word and one L2 word, and
+//    only continues over L2 (four words per step with AVX2) when whole
+//    BITS^2 units blocks are allocated. Summaries are updated together with
+//    every Used word.
+//
+//    Run summaries R1 and R2 hold free run lengths of every group of units
+//    covered by one L1 word (BITS^2 units) and one L2 word (BITS^3 units):
+//    free units at the group beginning, at the group end and the longest
+//    free run within the group. A run of 'need' units that starts in a
+//    group whose longest run is shorter can only be the run at the group
+//    end that continues into the next group, so the search jumps over the
+//    rest of such groups.
+//
+//    Run summaries are refreshed lazily, set() only marks the groups. After
+//    allocation the stored lengths can only be larger than the real ones,
+//    such group is LOOSE: a group whose longest run is too short even by
+//    the upper bound is skipped (the jump to the run at the group end goes
+//    to the first free unit after it), otherwise L1 group is refreshed
+//    before its runs are walked. After release the group is STALE and is
+//    not used before refresh. The search refreshes only L1 groups it
+//    stands on, the cost is bounded by the walk over the group it saves;
+//    L2 groups are refreshed by stats(), which refreshes all marked groups
+//    and reads the largest run from R2 items.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include "heap.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule = 16>
+class bitmap_manager
+{
+public:
+    typedef typename manager<guard>::summary summary;
+
+    // Heap initialization
+    template<size_t size_items>
+    bitmap_manager(int (& pool)[size_items]);
+
+    template<size_t size_bytes>
+    bitmap_manager(pool<size_bytes> & pool_obj);
+
+    bitmap_manager(int * pool, size_t size_bytes);
+
+    // Allocate 'size' bytes rounded up to granule, returned pointer is
+    // aligned to granule. In case of lack of memory the function returns NULL.
+    void *malloc( size_t size );
+
+    // Deallocates memory pointed by 'ptr'. Pointers that were not returned
+    // by malloc() or were already released are ignored
+    void free( void *ptr );
+
+    // Info about count and sizes of free and allocated memory chunks
+    summary info();
+
+    // Cheap variant of info(): totals are taken from counters, the largest
+    // free run from run summaries. Used.Block_max_size is not tracked and
+    // is returned as zero. Marked summaries are refreshed, so the function
+    // takes exclusive access
+    summary stats();
+
+private:
+    typedef uintptr_t word;
+
+    static unsigned const BITS = sizeof(word) * 8;
+
+    static_assert(granule >= sizeof(int) && !(granule & (granule - 1)), "granule must be power of 2");
+
+    void init(int * pool, size_t size_bytes);
+
+    // Run summary state
+    enum
+    {
+        EXACT = 0,
+        LOOSE = 1,             // units were allocated, lengths are upper bounds
+        STALE = 2              // units were released
+    };
+
+    // Free runs of a group of units
+    struct run
+    {
+        size_t pre;            // free units at the group beginning
+        size_t suf;            // free units at the group end
+        size_t max;            // the longest free run within the group
+    };
+
+    static unsigned lowest_one(word x);        // x must be non-zero
+    static unsigned highest_one(word x);       // x must be non-zero
+    static word     mask(size_t from, size_t to);
+
+    // Append group 'r' of 'length' units to 'sum' of the preceding 'done' units
+    static void     join(run & sum, size_t done, run const & r, size_t length);
+
+    static size_t scan_full(word const *map, size_t w, size_t words);
+    static void   assign(word *map, size_t bit, bool value);
+
+    size_t skip_full(size_t w) const;          // first word at or after 'w' with zero bits
+    size_t next_zero(size_t index) const;      // first free unit at or after 'index', N if none
+    size_t next_one(word const *map, size_t index, size_t limit) const;
+    void   set(size_t first, size_t last, bool used);
+    void   update(size_t w);                   // refresh summaries of Used word 'w'
+    run    group1(size_t g1) const;            // free runs of L1 word 'g1' taken from Used
+    run    group2(size_t g2) const;            // free runs of L2 word 'g2' taken from fresh R1
+    void   refresh(size_t g2, unsigned state); // refresh run summaries of L2 word 'g2' marked by 'state'
+    size_t skip(size_t index, size_t need);    // skip groups without runs of 'need' units
+    size_t find(size_t index, size_t need);    // first free run of 'need' units at or after 'index'
+    bool   is_free(size_t index) const { return index < Count && !(Used[index / BITS] >> (index % BITS) & 1); }
+
+    word   *Used;          // 1 - unit is allocated
+    word   *Last;          // 1 - unit is the last one of allocated chunk
+    word   *L1;            // 1 - Used word is full
+    word   *L2;            // 1 - L1 word is full
+    run    *R1;            // free runs of units of L1 words
+    run    *R2;            // free runs of units of L2 words
+    unsigned char *State1; // state of R1 items
+    unsigned char *State2; // state of R2 items, all states of its R1 items
+    char   *Data;          // data area, granule aligned
+    size_t  Count;         // number of units
+    size_t  Words;         // number of words in Used and Last bitmaps
+    size_t  Words1;        // number of words in L1
+    size_t  Words2;        // number of words in L2
+    size_t  Hint;          // first free unit or below
+    size_t  Used_units;    // number of allocated units
+    size_t  Used_blocks;   // number of allocated chunks
+    size_t  Free_blocks;   // number of free runs
+
+    guard   Guard;         // thread-safe support
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+template<size_t size_items>
+bitmap_manager<guard, granule>::bitmap_manager(int (& pool)[size_items])
+    : Guard()
+{
+    init(pool, sizeof(pool));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+template<size_t size_bytes>
+bitmap_manager<guard, granule>::bitmap_manager(pool<size_bytes> & pool_obj)
+    : Guard()
+{
+    init(pool_obj.Pool, sizeof(pool_obj));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+bitmap_manager<guard, granule>::bitmap_manager(int * pool, size_t size_bytes)
+    : Guard()
+{
+    init(pool, size_bytes);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::init(int * pool, size_t size_bytes)
+{
+    uintptr_t begin = ((uintptr_t)pool + sizeof(word) - 1) & ~(uintptr_t)(sizeof(word) - 1);
+    uintptr_t end   = (uintptr_t)pool + size_bytes;
+
+    Count = end > begin ? (end - begin) * 8 / (granule * 8 + 2) : 0;
+    for(;;)
+    {
+        Words  = (Count + BITS - 1) / BITS;
+        Words1 = (Words + BITS - 1) / BITS;
+        Words2 = (Words1 + BITS - 1) / BITS;
+        uintptr_t data = (begin + (2 * Words + Words1 + Words2) * sizeof(word) + (Words1 + Words2) * (sizeof(run) + 1)
+                          + granule - 1) & ~(uintptr_t)(granule - 1);
+        if( data + Count * granule <= end )
+        {
+            Data = (char *)data;
+            break;
+        }
+        --Count;                                // bitmap rounding took the last unit
+    }
+
+    Used   = (word *)begin;
+    Last   = Used + Words;
+    L1     = Last + Words;
+    L2     = L1 + Words1;
+    R1     = (run *)(L2 + Words2);
+    R2     = R1 + Words1;
+    State1 = (unsigned char *)(R2 + Words2);
+    State2 = State1 + Words1;
+    for(size_t i = 0; i < Words; ++i)
+    {
+        Used[i] = 0;
+        Last[i] = 0;
+    }
+    for(size_t i = 0; i < Words1; ++i)
+    {
+        L1[i]     = 0;
+        State1[i] = STALE;
+    }
+    for(size_t i = 0; i < Words2; ++i)
+        L2[i] = 0;
+
+    // Tail bits of the last words do not correspond to units and are
+    // marked as allocated
+    if( Count % BITS )
+        Used[Words - 1] = ~(word)0 << (Count % BITS);
+    if( Words % BITS )
+        L1[Words1 - 1] = ~(word)0 << (Words % BITS);
+    if( Words1 % BITS )
+        L2[Words2 - 1] = ~(word)0 << (Words1 % BITS);
+    if( Words )
+        update(Words - 1);
+    for(size_t i = 0; i < Words2; ++i)
+        refresh(i, STALE);
+
+    Hint        = 0;
+    Used_units  = 0;
+    Used_blocks = 0;
+    Free_blocks = Count ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+unsigned bitmap_manager<guard, granule>::lowest_one(word x)
+{
+#if defined(__GNUC__)
+    return sizeof(word) == sizeof(unsigned long) ? __builtin_ctzl(x) : __builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while( !(x & 1) )
+    {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+unsigned bitmap_manager<guard, granule>::highest_one(word x)
+{
+#if defined(__GNUC__)
+    return BITS - 1 - (sizeof(word) == sizeof(unsigned long) ? __builtin_clzl(x) : __builtin_clzll(x));
+#else
+    unsigned n = BITS - 1;
+    while( !(x >> n) )
+        --n;
+    return n;
+#endif
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::join(run & sum, size_t done, run const & r, size_t length)
+{
+    if( r.pre == length )                       // all units of 'r' are free
+    {
+        if( sum.pre == done )
+            sum.pre += length;
+        sum.suf += length;
+        if( sum.max < sum.suf )
+            sum.max = sum.suf;
+        return;
+    }
+    size_t n = sum.suf + r.pre;                 // run across the boundary
+    if( sum.pre == done )
+        sum.pre = n;
+    if( sum.max < n )
+        sum.max = n;
+    if( sum.max < r.max )
+        sum.max = r.max;
+    sum.suf = r.suf;
+}
+
+//------------------------------------------------------------------------------
+//  bits [from, to] of one word, 0 <= from <= to < BITS
+template <typename guard, size_t granule>
+typename bitmap_manager<guard, granule>::word bitmap_manager<guard, granule>::mask(size_t from, size_t to)
+{
+    word high = to == BITS - 1 ? ~(word)0 : ((word)1 << (to + 1)) - 1;
+    return high & (~(word)0 << from);
+}
+
+//------------------------------------------------------------------------------
+//  first word of 'map' at or after 'w' that is not full, 'words' if none
+template <typename guard, size_t granule>
+size_t bitmap_manager<guard, granule>::scan_full(word const *map, size_t w, size_t words)
+{
+#if defined(__AVX2__)
+    if( sizeof(word) == 8 )
+    {
+        __m256i const ones = _mm256_set1_epi32(-1);
+        while( w + 4 <= words
+            && _mm256_testc_si256(_mm256_loadu_si256((__m256i const *)(map + w)), ones) )
+            w += 4;
+    }
+#endif
+    while( w < words && map[w] == ~(word)0 )
+        ++w;
+    return w;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::assign(word *map, size_t bit, bool value)
+{
+    if( value )
+        map[bit / BITS] |= (word)1 << (bit % BITS);
+    else
+        map[bit / BITS] &= ~((word)1 << (bit % BITS));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::update(size_t w)
+{
+    assign(L1, w, Used[w] == ~(word)0);
+    assign(L2, w / BITS, L1[w / BITS] == ~(word)0);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+typename bitmap_manager<guard, granule>::run bitmap_manager<guard, granule>::group1(size_t g1) const
+{
+    size_t end  = (g1 + 1) * BITS < Words ? (g1 + 1) * BITS : Words;
+    bool   head = true;                         // all units are free so far
+    run    sum  = { 0, 0, 0 };
+    for(size_t w = g1 * BITS; w < end; ++w)
+    {
+        word x = Used[w];
+        if( !x )
+        {
+            sum.suf += BITS;
+            continue;
+        }
+        size_t n = x == ~(word)0 ? sum.suf : sum.suf + lowest_one(x);
+        if( sum.max < n )
+            sum.max = n;
+        if( head )
+            sum.pre = n;
+        head = false;
+        if( x == ~(word)0 )
+        {
+            sum.suf = 0;
+            continue;
+        }
+        // Runs inside the word are shorter than BITS - 1
+        if( sum.max < BITS - 2 )
+        {
+            n = 0;
+            for(word f = ~x; f; f &= f >> 1)    // the longest run of zero bits
+                ++n;
+            if( sum.max < n )
+                sum.max = n;
+        }
+        sum.suf = BITS - 1 - highest_one(x);
+    }
+    if( sum.max < sum.suf )
+        sum.max = sum.suf;
+    if( head )
+        sum.pre = sum.suf;
+    return sum;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+typename bitmap_manager<guard, granule>::run bitmap_manager<guard, granule>::group2(size_t g2) const
+{
+    size_t end = (g2 + 1) * BITS < Words1 ? (g2 + 1) * BITS : Words1;
+    run    sum = { 0, 0, 0 };
+    for(size_t g1 = g2 * BITS; g1 < end; ++g1)
+        join(sum, (g1 - g2 * BITS) * BITS * BITS, R1[g1], BITS * BITS);
+    return sum;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::refresh(size_t g2, unsigned state)
+{
+    size_t   end = (g2 + 1) * BITS < Words1 ? (g2 + 1) * BITS : Words1;
+    unsigned all = EXACT;
+    for(size_t g1 = g2 * BITS; g1 < end; ++g1)
+    {
+        if( State1[g1] & state )
+        {
+            R1[g1]     = group1(g1);
+            State1[g1] = EXACT;
+        }
+        all |= State1[g1];
+    }
+    R2[g2]     = group2(g2);
+    State2[g2] = all;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+size_t bitmap_manager<guard, granule>::skip_full(size_t w) const
+{
+    if( w >= Words )
+        return Words;
+
+    // The rest of current L1 word
+    size_t w1 = w / BITS;
+    word   x  = L1[w1] | (((word)1 << (w % BITS)) - 1);
+    if( x == ~(word)0 )
+    {
+        // The rest of current L2 word, then L2 scan
+        ++w1;
+        if( w1 >= Words1 )
+            return Words;
+        size_t w2 = w1 / BITS;
+        x = L2[w2] | (((word)1 << (w1 % BITS)) - 1);
+        if( x == ~(word)0 )
+        {
+            w2 = scan_full(L2, w2 + 1, Words2);
+            if( w2 == Words2 )
+                return Words;
+            x = L2[w2];
+        }
+        w1 = w2 * BITS + lowest_one(~x);
+        x  = L1[w1];
+    }
+    return w1 * BITS + lowest_one(~x);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+size_t bitmap_manager<guard, granule>::next_zero(size_t index) const
+{
+    if( index >= Count )
+        return Count;
+
+    size_t w = index / BITS;
+    word   x = Used[w] | (((word)1 << (index % BITS)) - 1);
+    if( x == ~(word)0 )
+    {
+        w = skip_full(w + 1);
+        if( w == Words )
+            return Count;
+        x = Used[w];
+    }
+    return w * BITS + lowest_one(~x);
+}
+
+//------------------------------------------------------------------------------
+//  first set bit of 'map' in [index, limit), 'limit' if none
+template <typename guard, size_t granule>
+size_t bitmap_manager<guard, granule>::next_one(word const *map, size_t index, size_t limit) const
+{
+    size_t w = index / BITS;
+    word   x = map[w] & (~(word)0 << (index % BITS));
+    while( !x )
+    {
+        if( ++w * BITS >= limit )
+            return limit;
+        x = map[w];
+    }
+    size_t found = w * BITS + lowest_one(x);
+    return found < limit ? found : limit;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::set(size_t first, size_t last, bool used)
+{
+    size_t fw = first / BITS;
+    size_t lw = last / BITS;
+    for(size_t w = fw; w <= lw; ++w)
+    {
+        word m = mask(w == fw ? first % BITS : 0, w == lw ? last % BITS : BITS - 1);
+        if( used )
+            Used[w] |= m;
+        else
+            Used[w] &= ~m;
+        update(w);
+    }
+    for(size_t g1 = fw / BITS; g1 <= lw / BITS; ++g1)
+    {
+        State1[g1]        |= used ? LOOSE : STALE;
+        State2[g1 / BITS] |= used ? LOOSE : STALE;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+size_t bitmap_manager<guard, granule>::skip(size_t index, size_t need)
+{
+    size_t const UNITS1 = BITS * BITS;          // units of L1 word
+    size_t const UNITS2 = UNITS1 * BITS;        // units of L2 word
+    size_t const UNITS  = Words * BITS;
+
+    size_t start = index;
+    while( start < Count )
+    {
+        // Runs of a group whose longest run is too short are skipped up to
+        // the run at the group end, that one may continue in the next group
+        run const & r2   = R2[start / UNITS2];
+        size_t      end2 = (start / UNITS2 + 1) * UNITS2 < UNITS ? (start / UNITS2 + 1) * UNITS2 : UNITS;
+        if( !(State2[start / UNITS2] & STALE) && r2.max < need && start < end2 - r2.suf )
+        {
+            start = next_zero(end2 - r2.suf);
+            continue;
+        }
+        size_t g1 = start / UNITS1;
+        if( (State1[g1] & STALE) || (State1[g1] == LOOSE && R1[g1].max >= need) )
+        {
+            R1[g1]     = group1(g1);
+            State1[g1] = EXACT;
+        }
+        run const & r1   = R1[g1];
+        size_t      end1 = (start / UNITS1 + 1) * UNITS1 < UNITS ? (start / UNITS1 + 1) * UNITS1 : UNITS;
+        if( r1.max < need && start < end1 - r1.suf )
+        {
+            start = next_zero(end1 - r1.suf);
+            continue;
+        }
+        break;
+    }
+    return start;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+size_t bitmap_manager<guard, granule>::find(size_t index, size_t need)
+{
+    size_t start = next_zero(index);
+    while( start < Count )
+    {
+        size_t limit = Count - start > need ? start + need : Count;
+        size_t end   = next_one(Used, start, limit);
+        if( end - start == need )
+            return start;
+        start = skip(next_zero(end), need);
+    }
+    return Count;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void * bitmap_manager<guard, granule>::malloc( size_t size )
+{
+    if( size > Count * granule )                // larger than the heap, rounding would wrap
+        return 0;
+
+    size_t need = size ? (size + granule - 1) / granule : 1;
+
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+
+    size_t first = next_zero(Hint);
+    size_t start = find(first, need);
+    if( start == Count )
+        return 0;                               // No Memory
+
+    size_t end = start + need;
+    Free_blocks += is_free(start - 1) + is_free(end) - 1;     // start - 1 wraps for zero
+    set(start, end - 1, true);
+    Last[(end - 1) / BITS] |= (word)1 << ((end - 1) % BITS);
+    if( start == first )                        // no free runs have been passed
+        Hint = end;
+    Used_units += need;
+    ++Used_blocks;
+    return Data + start * granule;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void bitmap_manager<guard, granule>::free( void *ptr )
+{
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)Data;
+    if( !ptr || offset >= Count * granule || offset % granule )
+        return;
+
+    size_t index = offset / granule;
+
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+
+    // Unit must be allocated and be the first one of its chunk
+    if( !(Used[index / BITS] >> (index % BITS) & 1) )
+        return;
+    if( index )
+    {
+        size_t prev = index - 1;
+        if( (Used[prev / BITS] >> (prev % BITS) & 1) && !(Last[prev / BITS] >> (prev % BITS) & 1) )
+            return;
+    }
+
+    size_t last = next_one(Last, index, Count);
+    Free_blocks += 1 - is_free(index - 1) - is_free(last + 1);  // index - 1 wraps for zero
+    set(index, last, false);
+    Last[last / BITS] &= ~((word)1 << (last % BITS));
+    Used_units -= last + 1 - index;
+    --Used_blocks;
+    if( index < Hint )
+        Hint = index;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+typename bitmap_manager<guard, granule>::summary bitmap_manager<guard, granule>::info()
+{
+    summary Result =
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 }
+    };
+
+    shared_scope_guard<guard> ScopeGuard(Guard);    // protect the following code from asyncronous modification
+    for(size_t i = 0; i < Count; )
+    {
+        size_t next;
+        typename summary::info * pInfo;
+        if( Used[i / BITS] >> (i % BITS) & 1 )
+        {
+            next  = next_one(Last, i, Count) + 1;
+            pInfo = &Result.Used;
+        }
+        else
+        {
+            next  = next_one(Used, i, Count);
+            pInfo = &Result.Free;
+        }
+        size_t n = (next - i) * granule;
+        ++pInfo->Blocks;
+        pInfo->Size += n;
+        if( pInfo->Block_max_size < n )
+            pInfo->Block_max_size = n;
+        i = next;
+    }
+    return Result;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+typename bitmap_manager<guard, granule>::summary bitmap_manager<guard, granule>::stats()
+{
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+
+    run sum = { 0, 0, 0 };
+    for(size_t g2 = 0; g2 < Words2; ++g2)
+    {
+        if( State2[g2] )
+            refresh(g2, LOOSE | STALE);
+        join(sum, g2 * BITS * BITS * BITS, R2[g2], BITS * BITS * BITS);
+    }
+
+    summary Result =
+    {
+        { Used_blocks, 0, Used_units * granule },
+        { Free_blocks, sum.max * granule, (Count - Used_units) * granule }
+    };
+    return Result;
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_BITMAP_H__
+
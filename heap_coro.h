@@ -0,0 +1,173 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Coroutine frame allocator with per-thread recycling
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_CORO_H__
+#define HEAP_CORO_H__
+
+//------------------------------------------------------------------------------
+//  Coroutine Frame Cache
+//  ~~~~~~~~~~~~~~~~~~~~~
+//
+//    Frame sizes are rounded up to STEP and split into BUCKETS classes. 
+//    Every thread keeps its own LIFO list of released frames per class,
+//    linked through the first word of the frame:
+//
+//      class 0 (  1.. 64): frame -> frame -> 0
+//      class 1 ( 65..128): frame -> 0
+//      ...
+//      larger frames: heap manager directly
+//
+//    Allocation takes a cached frame of its class without any lock, heap
+//    manager (and its guard) is called only when the list is empty. Up to
+//    'max_cached' frames per class are kept, the rest are returned to the 
+//    heap. Cached frames of a thread are released by one free_batch() per
+//    class when the thread exits.
+//
+//    Promise mixin 'coroutine_frames' provides operator new and delete of
+//    the promise type, that are used by the compiler for coroutine frames.
+//    operator new returns NULL in case of lack of memory, so the promise
+//    type has to declare get_return_object_on_allocation_failure().
+//------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, manager<guard> & heap_obj, size_t max_cached = 32>
+class frame_cache
+{
+public:
+    static void *allocate( size_t size );
+    static void  deallocate( void *ptr, size_t size );
+
+private:
+    static size_t const STEP    = 64;
+    static size_t const BUCKETS = 16;
+
+    // Frames are aligned as by global operator new
+    static size_t const ALIGN   = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    struct bucket_set
+    {
+        void     *Head[BUCKETS];
+        unsigned  Count[BUCKETS];
+
+        bucket_set();
+        ~bucket_set();
+    };
+
+    static thread_local bucket_set Buckets;
+};
+
+//------------------------------------------------------------------------------
+//  Promise mixin: struct promise_type : heap::coroutine_frames<heap_guard, heap::Manager> { ... };
+template <typename guard, manager<guard> & heap_obj, size_t max_cached = 32>
+struct coroutine_frames
+{
+    static void *operator new(size_t size) noexcept      { return frame_cache<guard, heap_obj, max_cached>::allocate(size); }
+    static void  operator delete(void *ptr, size_t size) { frame_cache<guard, heap_obj, max_cached>::deallocate(ptr, size); }
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, manager<guard> & heap_obj, size_t max_cached>
+thread_local typename frame_cache<guard, heap_obj, max_cached>::bucket_set frame_cache<guard, heap_obj, max_cached>::Buckets;
+
+//------------------------------------------------------------------------------
+template <typename guard, manager<guard> & heap_obj, size_t max_cached>
+frame_cache<guard, heap_obj, max_cached>::bucket_set::bucket_set()
+{
+    for(size_t i = 0; i < BUCKETS; ++i)
+    {
+        Head[i]  = 0;
+        Count[i] = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, manager<guard> & heap_obj, size_t max_cached>
+frame_cache<guard, heap_obj, max_cached>::bucket_set::~bucket_set()
+{
+    void *Released[max_cached];
+    for(size_t i = 0; i < BUCKETS; ++i)
+    {
+        size_t n = 0;
+        for(void *ptr = Head[i]; ptr; ptr = *(void **)ptr)
+            Released[n++] = ptr;
+        heap_obj.free_batch(Released, n);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, manager<guard> & heap_obj, size_t max_cached>
+void * frame_cache<guard, heap_obj, max_cached>::allocate( size_t size )
+{
+    size_t index = size ? (size - 1) / STEP : 0;
+    if( index >= BUCKETS )
+        return heap_obj.malloc_aligned(size, ALIGN);
+
+    bucket_set & b = Buckets;
+    void *ptr = b.Head[index];
+    if( ptr )
+    {
+        b.Head[index] = *(void **)ptr;
+        --b.Count[index];
+        return ptr;
+    }
+    return heap_obj.malloc_aligned((index + 1) * STEP, ALIGN);  // any frame of the class fits
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, manager<guard> & heap_obj, size_t max_cached>
+void frame_cache<guard, heap_obj, max_cached>::deallocate( void *ptr, size_t size )
+{
+    size_t index = size ? (size - 1) / STEP : 0;
+    if( !ptr )
+        return;
+
+    bucket_set & b = Buckets;
+    if( index >= BUCKETS || b.Count[index] >= max_cached )
+    {
+        heap_obj.free(ptr);
+        return;
+    }
+    *(void **)ptr = b.Head[index];
+    b.Head[index] = ptr;
+    ++b.Count[index];
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_CORO_H__
+
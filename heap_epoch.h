@@ -0,0 +1,386 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Epoch-based deferred reclamation on top of heap manager
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_EPOCH_H__
+#define HEAP_EPOCH_H__
+
+//------------------------------------------------------------------------------
+//  Epoch-Based Reclamation
+//  ~~~~~~~~~~~~~~~~~~~~~~~
+//
+//    Every thread that reads shared lock-free structures owns a participant
+//    record attached to the reclaimer. Read-side critical region is bracketed
+//    by enter()/exit(): enter() publishes the global epoch observed by the
+//    thread, exit() clears the 'active' flag. No other shared data is touched
+//    by the readers.
+//
+//    Memory unlinked from the structure is passed to retire(). It is stored
+//    in participant's limbo bag stamped with the current global epoch. The
+//    global epoch advances only when all active participants have observed
+//    it, so when the global epoch is two steps ahead of the bag stamp, no
+//    reader can hold a reference to bag contents any more. Such bags are
+//    handed back to the heap manager by free_batch(), one guard acquisition
+//    per batch of retired pointers.
+//
+//    Limbo bags are lists of batches, batch storage is taken from the heap
+//    manager as well. Participant keeps one spare batch to avoid heap calls
+//    in steady state.
+//
+//    Participant is detached by its destructor (e.g. when the thread exits):
+//    its bags are flushed and the record is unlinked under the reclaimer 
+//    guard, which the epoch scan of collect() takes in shared mode.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size = 32>
+class reclaimer
+{
+    struct batch
+    {
+        batch  *next;
+        size_t  count;
+        void   *ptrs[batch_size];
+    };
+
+    struct bag
+    {
+        batch    *list;        // retired pointers, NULL if bag is empty
+        unsigned  stamp;       // global epoch the pointers were retired in
+    };
+
+public:
+    //--------------------------------------------------------------------------
+    // Per-thread record. Destructor detaches it from the reclaimer, so it
+    // must be destroyed outside critical region
+    //--------------------------------------------------------------------------
+    class participant
+    {
+    public:
+        participant();
+        ~participant();
+    private:
+        friend class reclaimer;
+
+        std::atomic<unsigned> Local;      // (observed epoch << 1) | ACTIVE
+        reclaimer            *Owner;      // reclaimer attached to, NULL if none
+        participant          *Next;       // next attached participant
+        batch                *Spare;      // cached empty batch
+        bag                   Bags[3];
+    };
+
+    reclaimer(manager<guard> & heap_obj);
+    ~reclaimer();
+
+    // Register participant, lock-free. Must be done once before any other
+    // use of the record
+    void attach(participant & p);
+
+    // Flush everything retired by 'p', then unregister it. Must be called
+    // outside critical region. Called by destructor of the participant
+    void detach(participant & p);
+
+    // Read-side critical region. Regions may not be nested
+    void enter(participant & p);
+    void exit(participant & p);
+
+    // Defer deallocation of 'ptr' until no reader can reference it. Can be
+    // called both inside and outside critical region. Returns false if there
+    // is no memory for the limbo bag, in which case 'ptr' is not retired
+    bool retire(participant & p, void *ptr);
+
+    // Try to advance global epoch and return safe bags of 'p' to heap
+    void collect(participant & p);
+
+    // Wait until everything retired by 'p' is returned to heap. Must be
+    // called outside critical region, e.g. before thread termination
+    void flush(participant & p);
+
+private:
+    static unsigned const ACTIVE     = 1;
+    static unsigned const EPOCH_MASK = ~0u >> 1;
+
+    unsigned advance();
+    void     reclaim(participant & p, unsigned current);
+    void     release(participant & p, bag & b);
+
+    manager<guard>              & Heap;
+    guard                         Guard;           // protects unlinking of participants
+    std::atomic<unsigned>         Global;          // global epoch
+    std::atomic<participant *>    Participants;    // attached participants list
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+reclaimer<guard, batch_size>::participant::participant()
+    : Local(0)
+    , Owner(0)
+    , Next(0)
+    , Spare(0)
+{
+    for(int i = 0; i < 3; ++i)
+    {
+        Bags[i].list  = 0;
+        Bags[i].stamp = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+reclaimer<guard, batch_size>::participant::~participant()
+{
+    if( Owner )
+        Owner->detach(*this);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+reclaimer<guard, batch_size>::reclaimer(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Guard()
+    , Global(0)
+    , Participants(0)
+{
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+reclaimer<guard, batch_size>::~reclaimer()
+{
+    // No readers are expected at this point, all limbo contents are freed
+    for(participant *p = Participants.load(std::memory_order_acquire); p; p = p->Next)
+    {
+        for(int i = 0; i < 3; ++i)
+            release(*p, p->Bags[i]);
+        Heap.free(p->Spare);
+        p->Spare = 0;
+        p->Owner = 0;                   // participants left behind do not detach
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::attach(participant & p)
+{
+    p.Owner = this;
+
+    participant *head = Participants.load(std::memory_order_relaxed);
+    do
+    {
+        p.Next = head;
+    }
+    while( !Participants.compare_exchange_weak(head, &p,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed) );
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::detach(participant & p)
+{
+    flush(p);
+    {
+        scope_guard<guard> ScopeGuard(Guard);   // no epoch scan walks through the record
+
+        // attach() may push new records meanwhile, then the record is not
+        // the head any more and is unlinked from its predecessor. Links of
+        // attached records are changed under the guard only
+        participant *head = &p;
+        if( !Participants.compare_exchange_strong(head, p.Next,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire) )
+        {
+            while( head->Next != &p )
+                head = head->Next;
+            head->Next = p.Next;
+        }
+    }
+    Heap.free(p.Spare);
+    p.Spare = 0;
+    p.Next  = 0;
+    p.Owner = 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::enter(participant & p)
+{
+    unsigned epoch = Global.load(std::memory_order_relaxed);
+    p.Local.store((epoch << 1) | ACTIVE, std::memory_order_relaxed);
+
+    // Store-load barrier: the announcement becomes visible before any load
+    // from the protected structure, whatever order those loads use. Pairs
+    // with the fence of advance()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::exit(participant & p)
+{
+    p.Local.store(p.Local.load(std::memory_order_relaxed) & ~ACTIVE, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+unsigned reclaimer<guard, batch_size>::advance()
+{
+    unsigned epoch = Global.load(std::memory_order_seq_cst);
+
+    // Pairs with the fence of enter(): either the reader's announcement is
+    // seen by the scan below, or the reader sees the structure without 
+    // memory retired before this point
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        shared_scope_guard<guard> ScopeGuard(Guard);    // records are not detached during the scan
+        for(participant *p = Participants.load(std::memory_order_acquire); p; p = p->Next)
+        {
+            unsigned local = p->Local.load(std::memory_order_seq_cst);
+            if( (local & ACTIVE) && (local >> 1) != epoch )
+                return epoch;           // somebody still works in previous epoch
+        }
+    }
+
+    unsigned next = (epoch + 1) & EPOCH_MASK;
+    if( Global.compare_exchange_strong(epoch, next, std::memory_order_seq_cst) )
+        return next;
+    return epoch;                       // advanced by another thread
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::release(participant & p, bag & b)
+{
+    batch *bt = b.list;
+    while( bt )
+    {
+        batch *next = bt->next;
+        Heap.free_batch(bt->ptrs, bt->count);
+        if( !p.Spare )
+            p.Spare = bt;
+        else
+            Heap.free(bt);
+        bt = next;
+    }
+    b.list = 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::reclaim(participant & p, unsigned current)
+{
+    for(int i = 0; i < 3; ++i)
+    {
+        bag & b = p.Bags[i];
+        if( b.list && ((current - b.stamp) & EPOCH_MASK) >= 2 )
+            release(p, b);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::collect(participant & p)
+{
+    reclaim(p, advance());
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+void reclaimer<guard, batch_size>::flush(participant & p)
+{
+    for(;;)
+    {
+        collect(p);
+        if( !p.Bags[0].list && !p.Bags[1].list && !p.Bags[2].list )
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t batch_size>
+bool reclaimer<guard, batch_size>::retire(participant & p, void *ptr)
+{
+    unsigned epoch = Global.load(std::memory_order_acquire);
+
+    // Look for the bag of current epoch. If there is no one, reuse the
+    // empty or the oldest bag. Bag stamps are distinct, so the oldest one
+    // is at least three epochs behind and can be released right away
+    bag *b = 0;
+    for(int i = 0; i < 3; ++i)
+    {
+        bag & cur = p.Bags[i];
+        if( cur.list && cur.stamp == epoch )
+        {
+            b = &cur;
+            break;
+        }
+        if( !b || !cur.list || (b->list && ((epoch - cur.stamp) & EPOCH_MASK) > ((epoch - b->stamp) & EPOCH_MASK)) )
+            b = &cur;
+    }
+    if( b->stamp != epoch || !b->list )
+    {
+        release(p, *b);
+        b->stamp = epoch;
+    }
+
+    batch *bt = b->list;
+    if( !bt || bt->count == batch_size )
+    {
+        bt = p.Spare;
+        if( bt )
+            p.Spare = 0;
+        else
+            bt = (batch *)Heap.malloc(sizeof(batch));
+        if( !bt )
+            return false;
+        bt->next  = b->list;
+        bt->count = 0;
+        b->list   = bt;
+    }
+    bt->ptrs[bt->count++] = ptr;
+
+    if( bt->count == batch_size )       // reclaim once per batch
+        collect(p);
+    return true;
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_EPOCH_H__
+
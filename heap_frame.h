@@ -0,0 +1,223 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Double-buffered frame allocator for per-tick data
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_FRAME_H__
+#define HEAP_FRAME_H__
+
+//------------------------------------------------------------------------------
+//  Frame Allocator Structure
+//  ~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+//    Two regions of 'frame_bytes' are taken from heap manager. One region 
+//    is current: allocation moves its bump pointer. swap() makes the other
+//    region current and resets it, so data allocated during a tick stays
+//    valid until the end of the next tick:
+//
+//    tick N:    [ frame 0: alloc -> ]   [ frame 1: data of tick N-1 ]
+//    swap()
+//    tick N+1:  [ frame 0: data of tick N ]   [ frame 1: reset, alloc -> ]
+//
+//    When the current region is exhausted, the block is taken from heap 
+//    manager with a link header in front of it and is put to the overflow
+//    list of the frame; the list is released when the frame is reset.
+//
+//    Every frame keeps high-water mark of its usage (overflow included),
+//    that is the region size that would be enough for the workload.
+//
+//    The allocator is not thread-safe, use one allocator per thread.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard>
+class frame_allocator
+{
+public:
+    struct frame_info
+    {
+        size_t Used;            // bytes allocated in the frame since reset,
+                                // sizes are rounded up to alignment
+        size_t High_water;      // maximum of Used over all ticks
+        size_t Overflow_blocks; // blocks taken from heap manager since reset
+        size_t Overflow_size;
+    };
+
+    frame_allocator(manager<guard> & heap_obj, size_t frame_bytes);
+    ~frame_allocator();
+
+    // Allocate 'size' bytes aligned to 'align' (power of 2) in the current
+    // frame. In case of lack of memory the function returns NULL
+    void *malloc( size_t size, size_t align = sizeof(void *) );
+
+    // End of tick: make the other frame current and reset it
+    void swap();
+
+    // Frame 0 or 1 info
+    frame_info info( unsigned index ) const { return Frames[index].Info; }
+
+    // Index of the current frame
+    unsigned current() const { return Current; }
+
+private:
+    frame_allocator(frame_allocator const &);
+    frame_allocator & operator=(frame_allocator const &);
+
+    struct frame
+    {
+        char       *Begin;
+        char       *Pos;
+        char       *End;
+        void       *Overflow;   // blocks from heap manager, linked through the first word
+        frame_info  Info;
+    };
+
+    // Release overflow blocks and rewind bump pointer
+    void reset( frame & f );
+
+    void *overflow( frame & f, size_t size, size_t align );
+
+    manager<guard> & Heap;
+    frame            Frames[2];
+    unsigned         Current;
+};
+
+//------------------------------------------------------------------------------
+template <typename guard>
+frame_allocator<guard>::frame_allocator(manager<guard> & heap_obj, size_t frame_bytes)
+    : Heap(heap_obj)
+    , Current(0)
+{
+    for(unsigned i = 0; i < 2; ++i)
+    {
+        frame & f = Frames[i];
+        f.Begin    = (char *)Heap.malloc(frame_bytes);
+        f.Pos      = f.Begin;
+        f.End      = f.Begin ? f.Begin + frame_bytes : 0;   // no region - every block overflows
+        f.Overflow = 0;
+        frame_info Initial = { 0, 0, 0, 0 };
+        f.Info = Initial;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard>
+frame_allocator<guard>::~frame_allocator()
+{
+    for(unsigned i = 0; i < 2; ++i)
+    {
+        reset(Frames[i]);
+        Heap.free(Frames[i].Begin);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard>
+void frame_allocator<guard>::reset( frame & f )
+{
+    while( f.Overflow )
+    {
+        void *next = *(void **)f.Overflow;
+        Heap.free(f.Overflow);
+        f.Overflow = next;
+    }
+    f.Pos = f.Begin;
+    f.Info.Used            = 0;
+    f.Info.Overflow_blocks = 0;
+    f.Info.Overflow_size   = 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard>
+void * frame_allocator<guard>::overflow( frame & f, size_t size, size_t align )
+{
+    // Link header, then block aligned as requested
+    char *block = (char *)Heap.malloc(sizeof(void *) + align - 1 + size);
+    if( !block )
+        return 0;
+
+    *(void **)block = f.Overflow;
+    f.Overflow = block;
+    ++f.Info.Overflow_blocks;
+    f.Info.Overflow_size += size;
+
+    uintptr_t p = ((uintptr_t)block + sizeof(void *) + align - 1) & ~(uintptr_t)(align - 1);
+    return (void *)p;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard>
+void * frame_allocator<guard>::malloc( size_t size, size_t align )
+{
+    // Overflow block and usage counter add header and alignment to 'size'
+    if( size > ~(size_t)0 - sizeof(void *) - align + 1 )
+        return 0;
+
+    frame & f = Frames[Current];
+
+    void *Allocated;
+    uintptr_t p = ((uintptr_t)f.Pos + align - 1) & ~(uintptr_t)(align - 1);
+    if( f.Begin && p + size <= (uintptr_t)f.End && p + size >= p )
+    {
+        f.Pos = (char *)(p + size);
+        Allocated = (void *)p;
+    }
+    else
+    {
+        Allocated = overflow(f, size, align);
+        if( !Allocated )
+            return 0;                           // No Memory
+    }
+
+    f.Info.Used += (size + align - 1) & ~(align - 1);
+    if( f.Info.High_water < f.Info.Used )
+        f.Info.High_water = f.Info.Used;
+    return Allocated;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard>
+void frame_allocator<guard>::swap()
+{
+    Current ^= 1;
+    reset(Frames[Current]);
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_FRAME_H__
+
@@ -0,0 +1,281 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: String interner on monotonic heap arena
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_INTERN_H__
+#define HEAP_INTERN_H__
+
+//------------------------------------------------------------------------------
+//  String Interner Structure
+//  ~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+//    Characters of interned strings are placed one after another in arena 
+//    blocks taken from heap manager, each string is terminated by '\0'. 
+//    Blocks are never released until the interner is destroyed, so strings
+//    never move:
+//
+//    +------+-------------------------------------------+
+//    | next | "cpu\0" "mem\0" "net.rx\0" ...   | unused |
+//    +------+-------------------------------------------+
+//
+//    Strings are indexed by open addressing hash table with linear probing,
+//    entry holds string pointer, length and hash. Table is taken from heap 
+//    manager and is doubled when insertion of a new string makes load 
+//    exceed 3/4. find() locks the guard shared if it has lock_shared(), 
+//    so lookups from several threads do not serialize.
+//
+//    Interned strings with equal contents have equal data pointers, so
+//    they can be compared by pointer. Heap manager is called only when a
+//    new arena block or larger table is needed.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string_view>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size = 4096>
+class interner
+{
+public:
+    interner(manager<guard> & heap_obj);
+    ~interner();
+
+    // Stable copy of 'str'. Data pointer is NULL in case of lack of memory
+    std::string_view intern( std::string_view str );
+
+    // Interned copy of 'str' if it exists, otherwise data pointer is NULL
+    std::string_view find( std::string_view str );
+
+    // Number of interned strings
+    size_t size() const { return Count; }
+
+private:
+    interner(interner const &);
+    interner & operator=(interner const &);
+
+    struct entry
+    {
+        char const *Str;       // NULL for empty slot
+        uint32_t    Length;
+        uint32_t    Hash;
+    };
+
+    static size_t const INITIAL_SLOTS = 64;
+
+    static uint32_t hash( std::string_view str );
+
+    // Slot of 'str' or empty slot where it should be placed
+    entry * lookup( std::string_view str, uint32_t h ) const;
+
+    // Copy of 'str' in arena
+    char const * store( std::string_view str );
+
+    bool rehash( size_t slots );
+
+    manager<guard> & Heap;
+    guard            Guard;        // thread-safe support
+
+    entry           *Table;
+    size_t           Slots;        // power of 2
+    size_t           Count;
+
+    void            *Blocks;       // arena blocks, linked through the first word
+    char            *Pos;          // free space of the current block
+    char            *End;
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+interner<guard, block_size>::interner(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Guard()
+    , Table(0)
+    , Slots(0)
+    , Count(0)
+    , Blocks(0)
+    , Pos(0)
+    , End(0)
+{
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+interner<guard, block_size>::~interner()
+{
+    while( Blocks )
+    {
+        void *next = *(void **)Blocks;
+        Heap.free(Blocks);
+        Blocks = next;
+    }
+    Heap.free(Table);
+}
+
+//------------------------------------------------------------------------------
+//  FNV-1a
+template <typename guard, size_t block_size>
+uint32_t interner<guard, block_size>::hash( std::string_view str )
+{
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < str.size(); ++i)
+    {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+typename interner<guard, block_size>::entry * interner<guard, block_size>::lookup( std::string_view str, uint32_t h ) const
+{
+    for(size_t i = h & (Slots - 1); ; i = (i + 1) & (Slots - 1))
+    {
+        entry *e = Table + i;
+        if( !e->Str )
+            return e;
+        if( e->Hash == h && e->Length == str.size() && !memcmp(e->Str, str.data(), str.size()) )
+            return e;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+char const * interner<guard, block_size>::store( std::string_view str )
+{
+    size_t need = str.size() + 1;
+    if( (size_t)(End - Pos) < need )
+    {
+        // Long strings get their own block, the current one stays open
+        bool   own  = need > block_size / 4;
+        size_t size = sizeof(void *) + (own ? need : block_size);
+        char  *block = (char *)Heap.malloc_aligned(size, alignof(void *));   // link is the first word
+        if( !block )
+            return 0;
+        *(void **)block = Blocks;
+        Blocks = block;
+        if( own )
+        {
+            memcpy(block + sizeof(void *), str.data(), str.size());
+            block[sizeof(void *) + str.size()] = '\0';
+            return block + sizeof(void *);
+        }
+        Pos = block + sizeof(void *);
+        End = block + size;
+    }
+
+    char *s = Pos;
+    memcpy(s, str.data(), str.size());
+    s[str.size()] = '\0';
+    Pos += need;
+    return s;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+bool interner<guard, block_size>::rehash( size_t slots )
+{
+    entry *New = (entry *)Heap.malloc_aligned(slots * sizeof(entry), alignof(entry));
+    if( !New )
+        return false;
+    for(size_t i = 0; i < slots; ++i)
+        New[i].Str = 0;
+
+    entry *Old = Table;
+    size_t old_slots = Slots;
+    Table = New;
+    Slots = slots;
+    for(size_t i = 0; i < old_slots; ++i)
+    {
+        if( Old[i].Str )
+            *lookup(std::string_view(Old[i].Str, Old[i].Length), Old[i].Hash) = Old[i];
+    }
+    Heap.free(Old);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+std::string_view interner<guard, block_size>::intern( std::string_view str )
+{
+    if( str.size() > UINT32_MAX )
+        return std::string_view();
+
+    uint32_t h = hash(str);
+
+    scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous access
+
+    entry *e = Slots ? lookup(str, h) : 0;
+    if( e && e->Str )
+        return std::string_view(e->Str, e->Length);
+
+    // Table grows only when a new string is inserted
+    if( (Count + 1) * 4 > Slots * 3 )
+    {
+        if( !rehash(Slots ? Slots * 2 : INITIAL_SLOTS) )
+            return std::string_view();
+        e = lookup(str, h);
+    }
+
+    char const *s = store(str);
+    if( !s )
+        return std::string_view();
+    e->Str    = s;
+    e->Length = (uint32_t)str.size();
+    e->Hash   = h;
+    ++Count;
+    return std::string_view(e->Str, e->Length);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t block_size>
+std::string_view interner<guard, block_size>::find( std::string_view str )
+{
+    uint32_t h = hash(str);
+
+    shared_scope_guard<guard> ScopeGuard(Guard);   // protect the following code from asyncronous modification
+    if( !Slots )
+        return std::string_view();
+
+    entry *e = lookup(str, h);
+    return e->Str ? std::string_view(e->Str, e->Length) : std::string_view();
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_INTERN_H__
+
@@ -0,0 +1,313 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Reference-counted buffer chain for zero-copy I/O
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_IOBUF_H__
+#define HEAP_IOBUF_H__
+
+//------------------------------------------------------------------------------
+//  Buffer Chain Structure
+//  ~~~~~~~~~~~~~~~~~~~~~~
+//
+//    Segment is a heap chunk that starts with reference counter and 
+//    capacity, data follows the header:
+//
+//    +------+----------+-----------------------------+
+//    | Refs | Capacity | data                        |
+//    +------+----------+-----------------------------+
+//
+//    Chain is a fixed-size array of slices, slice is (segment, offset, 
+//    length) and holds one reference to its segment:
+//
+//    chain: [ seg A, 0, 100 ][ seg B, 16, 40 ][ seg A, 200, 50 ] ...
+//
+//    Appending a part of another chain copies slices and increments 
+//    reference counters, payload is never copied. Slices are converted to
+//    any iovec-like array (fields iov_base and iov_len) for writev() and
+//    readv(). Segments whose counters drop to zero while the chain is 
+//    consumed or released are returned to the heap by single free_batch()
+//    call.
+//------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <atomic>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+class io_segment
+{
+public:
+    char * data() { return (char *)(this + 1); }
+    size_t capacity() const { return Capacity; }
+
+    std::atomic<unsigned> Refs;
+    size_t                Capacity;
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices = 16>
+class io_chain
+{
+public:
+    io_chain(manager<guard> & heap_obj);
+    ~io_chain();
+
+    // Number of bytes and number of slices in the chain
+    size_t size()  const;
+    size_t count() const { return Count; }
+
+    // Allocate new segment of 'capacity' bytes and append it as a slice 
+    // that covers the whole segment. Returns pointer to segment data, 
+    // NULL in case of lack of memory or slots
+    char * grow( size_t capacity );
+
+    // Append 'length' bytes of 'other' starting from 'offset' without 
+    // copying the payload. Returns false and leaves the chain unchanged if
+    // slots are exhausted or the range runs past the end of 'other'
+    template<size_t other_slices>
+    bool append( io_chain<guard, other_slices> const & other, size_t offset, size_t length );
+
+    // Fill iovec-like array, returns number of filled items
+    template<typename iov>
+    size_t to_iovec( iov *vec, size_t max ) const;
+
+    // Drop 'bytes' from the beginning of the chain (e.g. written by writev)
+    void consume( size_t bytes );
+
+    // Keep only 'bytes' from the beginning of the chain (e.g. read by readv)
+    void truncate( size_t bytes );
+
+    // Drop all slices
+    void release();
+
+private:
+    template <typename, size_t> friend class io_chain;
+
+    io_chain(io_chain const &);
+    io_chain & operator=(io_chain const &);
+
+    struct slice
+    {
+        io_segment *Segment;
+        size_t      Offset;
+        size_t      Length;
+    };
+
+    // Append 'length' bytes of 'seg' starting from 'offset'
+    bool append( io_segment *seg, size_t offset, size_t length );
+
+    // Release references of slices [first, first + count), free segments
+    // whose counters dropped to zero
+    void drop( size_t first, size_t count );
+
+    manager<guard> & Heap;
+    size_t           Count;
+    slice            Slices[max_slices];
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+io_chain<guard, max_slices>::io_chain(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Count(0)
+{
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+io_chain<guard, max_slices>::~io_chain()
+{
+    release();
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+size_t io_chain<guard, max_slices>::size() const
+{
+    size_t Result = 0;
+    for(size_t i = 0; i < Count; ++i)
+        Result += Slices[i].Length;
+    return Result;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+char * io_chain<guard, max_slices>::grow( size_t capacity )
+{
+    if( Count == max_slices || capacity > ~(size_t)0 - sizeof(io_segment) )
+        return 0;
+
+    // Refs is atomic, so the chunk is aligned to its alignment
+    io_segment *seg = (io_segment *)Heap.malloc_aligned(sizeof(io_segment) + capacity, alignof(io_segment));
+    if( !seg )
+        return 0;
+
+    seg->Refs.store(1, std::memory_order_relaxed);
+    seg->Capacity = capacity;
+
+    slice & s = Slices[Count++];
+    s.Segment = seg;
+    s.Offset  = 0;
+    s.Length  = capacity;
+    return seg->data();
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+bool io_chain<guard, max_slices>::append( io_segment *seg, size_t offset, size_t length )
+{
+    if( Count == max_slices || offset + length > seg->Capacity )
+        return false;
+
+    seg->Refs.fetch_add(1, std::memory_order_relaxed);
+
+    slice & s = Slices[Count++];
+    s.Segment = seg;
+    s.Offset  = offset;
+    s.Length  = length;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+template<size_t other_slices>
+bool io_chain<guard, max_slices>::append( io_chain<guard, other_slices> const & other, size_t offset, size_t length )
+{
+    size_t first = Count;
+    for(size_t i = 0; i < other.Count && length; ++i)
+    {
+        typename io_chain<guard, other_slices>::slice const & s = other.Slices[i];
+        if( offset >= s.Length )
+        {
+            offset -= s.Length;
+            continue;
+        }
+        size_t part = s.Length - offset < length ? s.Length - offset : length;
+        if( !append(s.Segment, s.Offset + offset, part) )
+        {
+            drop(first, Count - first);         // roll back
+            Count = first;
+            return false;
+        }
+        offset  = 0;
+        length -= part;
+    }
+    if( length )                                // range runs past the end of 'other'
+    {
+        drop(first, Count - first);
+        Count = first;
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+template<typename iov>
+size_t io_chain<guard, max_slices>::to_iovec( iov *vec, size_t max ) const
+{
+    size_t n = Count < max ? Count : max;
+    for(size_t i = 0; i < n; ++i)
+    {
+        vec[i].iov_base = Slices[i].Segment->data() + Slices[i].Offset;
+        vec[i].iov_len  = Slices[i].Length;
+    }
+    return n;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+void io_chain<guard, max_slices>::consume( size_t bytes )
+{
+    size_t n = 0;
+    while( n < Count && bytes >= Slices[n].Length )
+        bytes -= Slices[n++].Length;
+    drop(0, n);
+
+    Count -= n;
+    for(size_t i = 0; i < Count; ++i)
+        Slices[i] = Slices[i + n];
+
+    if( Count && bytes )                        // partially consumed slice
+    {
+        Slices[0].Offset += bytes;
+        Slices[0].Length -= bytes;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+void io_chain<guard, max_slices>::truncate( size_t bytes )
+{
+    size_t n = 0;
+    while( n < Count && bytes > Slices[n].Length )
+        bytes -= Slices[n++].Length;
+    if( n == Count )
+        return;
+
+    Slices[n].Length = bytes;
+    if( bytes )
+        ++n;
+    drop(n, Count - n);
+    Count = n;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+void io_chain<guard, max_slices>::release()
+{
+    drop(0, Count);
+    Count = 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_slices>
+void io_chain<guard, max_slices>::drop( size_t first, size_t count )
+{
+    void  *Released[max_slices];
+    size_t n = 0;
+    for(size_t i = first; i < first + count; ++i)
+    {
+        io_segment *seg = Slices[i].Segment;
+        if( seg->Refs.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+            Released[n++] = seg;
+    }
+    if( n )
+        Heap.free_batch(Released, n);
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_IOBUF_H__
+
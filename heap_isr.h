@@ -0,0 +1,164 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Wait-free reserved pool for interrupt and signal handlers
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_ISR_H__
+#define HEAP_ISR_H__
+
+//------------------------------------------------------------------------------
+//  Reserved Pool
+//  ~~~~~~~~~~~~~
+//
+//    Fixed number of equal items reserved for code that can not take the
+//    heap guard: interrupt service routines and signal handlers. Item
+//    state is kept in the bitmap, one bit per item (1 - allocated).
+//
+//    malloc() walks the bitmap words and claims the lowest free bit of a
+//    word by atomic OR. Bits already tried in the word are excluded from
+//    the next attempt, so allocation takes at most 'item_count' atomic
+//    operations whatever other contexts do: the function is wait-free.
+//    free() is a single atomic AND.
+//
+//    Memory obtained from heap manager is released from such contexts by
+//    manager::free_deferred().
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <size_t item_size, size_t item_count>
+class isr_pool
+{
+public:
+    isr_pool();
+
+    // Allocate one item, wait-free. Returns NULL if the pool is exhausted
+    void *malloc();
+
+    // Release item, wait-free. Pointers that do not belong to the pool
+    // are ignored
+    void free(void *ptr);
+
+    // Check whether 'ptr' points to item of the pool
+    bool owns(void *ptr) const;
+
+private:
+    typedef uintptr_t word;
+
+    static size_t const BITS       = sizeof(word) * 8;
+    static size_t const WORDS      = (item_count + BITS - 1) / BITS;
+    static size_t const ITEM_WORDS = (item_size + sizeof(word) - 1) / sizeof(word);
+
+    static_assert(ATOMIC_POINTER_LOCK_FREE == 2, "reserved pool requires lock-free atomic operations");
+
+    static unsigned lowest_zero(word x);
+
+    std::atomic<word> Map[WORDS];                  // 1 - item is allocated
+    word              Items[item_count * ITEM_WORDS];
+};
+
+//------------------------------------------------------------------------------
+template <size_t item_size, size_t item_count>
+isr_pool<item_size, item_count>::isr_pool()
+{
+    for(size_t i = 0; i < WORDS; ++i)
+        Map[i].store(0, std::memory_order_relaxed);
+
+    // Tail bits of the last word do not correspond to items
+    if( item_count % BITS )
+        Map[WORDS - 1].store(~(word)0 << (item_count % BITS), std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+template <size_t item_size, size_t item_count>
+unsigned isr_pool<item_size, item_count>::lowest_zero(word x)
+{
+#if defined(__GNUC__)
+    return sizeof(word) == sizeof(unsigned long) ? __builtin_ctzl(~x) : __builtin_ctzll(~x);
+#else
+    unsigned n = 0;
+    while( x & 1 )
+    {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+//------------------------------------------------------------------------------
+template <size_t item_size, size_t item_count>
+void * isr_pool<item_size, item_count>::malloc()
+{
+    for(size_t i = 0; i < WORDS; ++i)
+    {
+        word tried = Map[i].load(std::memory_order_relaxed);
+        while( ~tried )
+        {
+            unsigned bit  = lowest_zero(tried);
+            word     mask = (word)1 << bit;
+            word     old  = Map[i].fetch_or(mask, std::memory_order_acquire);
+            if( !(old & mask) )
+                return Items + (i * BITS + bit) * ITEM_WORDS;
+            tried |= old | mask;
+        }
+    }
+    return 0;                               // No Memory
+}
+
+//------------------------------------------------------------------------------
+template <size_t item_size, size_t item_count>
+bool isr_pool<item_size, item_count>::owns(void *ptr) const
+{
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)Items;
+    return offset < sizeof(Items) && offset % (ITEM_WORDS * sizeof(word)) == 0;
+}
+
+//------------------------------------------------------------------------------
+template <size_t item_size, size_t item_count>
+void isr_pool<item_size, item_count>::free(void *ptr)
+{
+    if( !owns(ptr) )
+        return;
+
+    size_t index = ((word *)ptr - Items) / ITEM_WORDS;
+    Map[index / BITS].fetch_and(~((word)1 << (index % BITS)), std::memory_order_release);
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_ISR_H__
+
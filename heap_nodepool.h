@@ -0,0 +1,283 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Lock-free fixed-size node pool fed from heap manager
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_NODEPOOL_H__
+#define HEAP_NODEPOOL_H__
+
+//------------------------------------------------------------------------------
+//  Node Pool Structure
+//  ~~~~~~~~~~~~~~~~~~~
+//
+//    Nodes are taken from the heap manager in blocks of 'nodes_per_block'
+//    items. Each block carries its node area followed by the link area:
+//
+//    +--------+--------+-...-+--------+------+------+-...-+------+
+//    | node 0 | node 1 |     | node K | lnk0 | lnk1 |     | lnkK |
+//    +--------+--------+-...-+--------+------+------+-...-+------+
+//
+//    Block is aligned to ALIGN: the largest fundamental alignment if node
+//    size is multiple of it, otherwise alignment of link. So every node 
+//    and every link is properly aligned.
+//
+//    Node is identified by index = block * nodes_per_block + item. Free nodes
+//    form a LIFO list through link area, so node storage itself is never
+//    touched by the pool and the list can not be broken by a stale write
+//    to released node.
+//
+//    List head is a single machine word: lower half holds index of the
+//    first free node, upper half holds modification tag. Tag is incremented
+//    on every head update, that protects compare-and-swap against ABA
+//    problem without double-width atomic operations.
+//
+//    Only block refill calls heap manager (and takes its guard), allocation
+//    and deallocation of nodes are lock-free.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block = 64, size_t max_blocks = 16>
+class node_pool
+{
+public:
+    node_pool(manager<guard> & heap_obj);
+    ~node_pool();
+
+    // Allocate one node. Heap manager is called only when the pool is
+    // empty. In case of lack of memory the function returns NULL.
+    void *malloc();
+
+    // Return node to the pool. Pointers that do not belong to the pool
+    // are ignored, false is returned for them.
+    bool free(void *ptr);
+
+    // Take blocks from heap manager in advance so that pool capacity
+    // is at least 'nodes' items. Returns false if heap manager
+    // or block table is exhausted.
+    bool reserve(size_t nodes);
+
+private:
+    typedef uintptr_t word;
+    typedef std::atomic<word> link;
+
+    static unsigned const INDEX_BITS = sizeof(word) * 4;
+    static word     const INDEX_MASK = ((word)1 << INDEX_BITS) - 1;
+    static word     const NIL        = INDEX_MASK;
+    static size_t   const NODE_SIZE  = (node_size + sizeof(word) - 1) & ~(sizeof(word) - 1);
+    static size_t   const BLOCK_SIZE = nodes_per_block * (NODE_SIZE + sizeof(link));
+
+    static_assert(nodes_per_block * max_blocks < NIL, "node pool is too large for index width");
+    static_assert(NODE_SIZE % alignof(link) == 0, "links of the block are misaligned");
+
+    char * node(word index) const;
+    link & next(word index) const;
+    word   find(void *ptr) const;
+
+    void push(word first, word last);
+    word refill();
+
+    manager<guard>    & Heap;
+    std::atomic<word>   Head;                  // tagged index of the first free node
+    std::atomic<size_t> Count;                 // number of blocks in use
+    std::atomic<char *> Blocks[max_blocks];
+
+public:
+    // Alignment of nodes
+    static size_t const ALIGN = NODE_SIZE % alignof(max_align_t) == 0 ? alignof(max_align_t) : alignof(link);
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+node_pool<guard, node_size, nodes_per_block, max_blocks>::node_pool(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Head(NIL)
+    , Count(0)
+{
+    for(size_t i = 0; i < max_blocks; ++i)
+        Blocks[i].store(0, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+node_pool<guard, node_size, nodes_per_block, max_blocks>::~node_pool()
+{
+    // All nodes are considered released at this point
+    size_t cnt = Count.load(std::memory_order_acquire);
+    for(size_t i = 0; i < cnt; ++i)
+        Heap.free(Blocks[i].load(std::memory_order_acquire));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+char * node_pool<guard, node_size, nodes_per_block, max_blocks>::node(word index) const
+{
+    char *block = Blocks[index / nodes_per_block].load(std::memory_order_relaxed);
+    return block + (index % nodes_per_block) * NODE_SIZE;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+typename node_pool<guard, node_size, nodes_per_block, max_blocks>::link &
+node_pool<guard, node_size, nodes_per_block, max_blocks>::next(word index) const
+{
+    char *block = Blocks[index / nodes_per_block].load(std::memory_order_relaxed);
+    return ((link *)(block + nodes_per_block * NODE_SIZE))[index % nodes_per_block];
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+typename node_pool<guard, node_size, nodes_per_block, max_blocks>::word
+node_pool<guard, node_size, nodes_per_block, max_blocks>::find(void *ptr) const
+{
+    size_t cnt = Count.load(std::memory_order_acquire);
+    for(size_t i = 0; i < cnt; ++i)
+    {
+        char *block = Blocks[i].load(std::memory_order_acquire);
+        if( !block )                           // slot is claimed but not filled yet
+            continue;
+        uintptr_t offset = (uintptr_t)ptr - (uintptr_t)block;
+        if( offset < nodes_per_block * NODE_SIZE && offset % NODE_SIZE == 0 )
+            return i * nodes_per_block + offset / NODE_SIZE;
+    }
+    return NIL;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+void node_pool<guard, node_size, nodes_per_block, max_blocks>::push(word first, word last)
+{
+    word old_head = Head.load(std::memory_order_relaxed);
+    word new_head;
+    do
+    {
+        next(last).store(old_head & INDEX_MASK, std::memory_order_relaxed);
+        new_head = first | (((old_head >> INDEX_BITS) + 1) << INDEX_BITS);
+    }
+    while( !Head.compare_exchange_weak(old_head, new_head,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed) );
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+typename node_pool<guard, node_size, nodes_per_block, max_blocks>::word
+node_pool<guard, node_size, nodes_per_block, max_blocks>::refill()
+{
+    char *block = (char *)Heap.malloc_aligned(BLOCK_SIZE, ALIGN);
+    if( !block )
+        return NIL;
+
+    // Claim block table slot. Concurrent refills get different slots
+    size_t slot = Count.load(std::memory_order_relaxed);
+    do
+    {
+        if( slot == max_blocks )
+        {
+            Heap.free(block);
+            return NIL;
+        }
+    }
+    while( !Count.compare_exchange_weak(slot, slot + 1, std::memory_order_relaxed) );
+    Blocks[slot].store(block, std::memory_order_release);
+
+    // The first node goes to the caller, the rest are chained
+    // and published by single head update
+    word first = slot * nodes_per_block;
+    word last  = first + nodes_per_block - 1;
+    for(word i = first + 1; i < last; ++i)
+        next(i).store(i + 1, std::memory_order_relaxed);
+    if( first != last )
+        push(first + 1, last);
+    return first;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+void * node_pool<guard, node_size, nodes_per_block, max_blocks>::malloc()
+{
+    word old_head = Head.load(std::memory_order_acquire);
+    for(;;)
+    {
+        word index = old_head & INDEX_MASK;
+        if( index == NIL )
+        {
+            index = refill();
+            return index == NIL ? 0 : node(index);
+        }
+        word new_head = next(index).load(std::memory_order_relaxed)
+                      | (((old_head >> INDEX_BITS) + 1) << INDEX_BITS);
+        if( Head.compare_exchange_weak(old_head, new_head,
+                                       std::memory_order_acquire,
+                                       std::memory_order_acquire) )
+            return node(index);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+bool node_pool<guard, node_size, nodes_per_block, max_blocks>::free(void *ptr)
+{
+    if( !ptr )
+        return true;
+    word index = find(ptr);
+    if( index == NIL )
+        return false;
+    push(index, index);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t node_size, size_t nodes_per_block, size_t max_blocks>
+bool node_pool<guard, node_size, nodes_per_block, max_blocks>::reserve(size_t nodes)
+{
+    size_t have = Count.load(std::memory_order_relaxed) * nodes_per_block;
+    while( have < nodes )
+    {
+        word index = refill();
+        if( index == NIL )
+            return false;
+        push(index, index);
+        have += nodes_per_block;
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_NODEPOOL_H__
+
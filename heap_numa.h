@@ -0,0 +1,309 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: NUMA node local heap arenas
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_NUMA_H__
+#define HEAP_NUMA_H__
+
+//------------------------------------------------------------------------------
+//  NUMA Arenas
+//  ~~~~~~~~~~~
+//
+//    Every online NUMA node gets its own heap arena. Arena memory is mapped
+//    anonymously and bound to the node by mbind() before it is touched, so
+//    all pages of the arena are allocated from the node local memory.
+//
+//    Allocation goes to the arena of the node the calling thread is running
+//    on. The node is queried by getcpu() once per NODE_REFRESH allocations
+//    of the thread and is cached in between, so thread migration to other
+//    node is followed with a small delay. If the local arena is exhausted,
+//    arenas of other nodes are used in node order. free() looks up the 
+//    owner arena by address, so chunks released by a thread of another 
+//    node are returned to the arena they were taken from.
+//
+//    On hosts without NUMA (or if the node list can not be read) there is
+//    a single arena, and mbind() failure is not considered an error: memory
+//    just stays under default policy.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <new>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include "heap.h"
+#include "heap_pagemap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes = 8>
+class numa_arenas
+{
+public:
+    // Map and bind 'node_bytes' bytes for every online node
+    numa_arenas(size_t node_bytes);
+    ~numa_arenas();
+
+    void *malloc( size_t size );
+    void  free( void *ptr );
+
+    // Number of node slots (highest online node + 1)
+    size_t nodes() const { return Nodes; }
+
+    // Check whether node has an arena
+    bool present(size_t node) const { return Base[node] != 0; }
+
+    manager<guard> & arena(size_t node) { return *(manager<guard> *)Arenas[node]; }
+
+    // Sum of info() of all arenas
+    typename manager<guard>::summary info();
+
+private:
+    static unsigned const NODE_REFRESH = 256;  // allocations between getcpu() calls
+
+    static unsigned long online();             // bit mask of online nodes
+    static size_t current();                   // node of the calling thread
+    static size_t query();                     // getcpu() node
+    static void   bind(void *addr, size_t size, size_t node);
+
+    typedef page_map<guard> map_type;
+
+    manager<guard> * owner(void *ptr);
+    map_type & map() { return *(map_type *)Map; }
+
+    size_t  Nodes;
+    size_t  Size;                              // arena size, bytes
+    char   *Base[max_nodes];                   // arena memory, NULL if there is no arena
+
+    alignas(manager<guard>) unsigned char Arenas[max_nodes][sizeof(manager<guard>)];
+    alignas(map_type)       unsigned char Map[sizeof(map_type)];    // valid if Nodes != 0
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+numa_arenas<guard, max_nodes>::numa_arenas(size_t node_bytes)
+    : Nodes(0)
+    , Size(node_bytes & ~(sizeof(void *) - 1))
+{
+    unsigned long mask = online();
+    for(size_t i = 0; i < max_nodes; ++i)
+    {
+        Base[i] = 0;
+        if( !(mask & (1ul << i)) )
+            continue;
+
+        void *mem = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if( mem == MAP_FAILED )
+            continue;
+
+        bind(mem, Size, i);                    // before the first touch of the memory
+        Base[i] = (char *)mem;
+        new (Arenas[i]) manager<guard>((int *)mem, Size, manager<guard>::NUMA_LOCAL);
+        if( !Nodes )
+            new (Map) map_type(arena(i));
+        Nodes = i + 1;
+        arena(i).map_pages(map(), (unsigned)i);    // if map is out of memory, owner is found by address
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+numa_arenas<guard, max_nodes>::~numa_arenas()
+{
+    if( Nodes )
+    {
+        // Nodes of the map are returned to the first arena, its free() must
+        // not look them up in the map being destroyed
+        for(size_t i = 0; i < Nodes; ++i)
+        {
+            if( Base[i] )
+                arena(i).unmap_pages();
+        }
+        map().~map_type();
+    }
+    for(size_t i = 0; i < Nodes; ++i)
+    {
+        if( !Base[i] )
+            continue;
+        arena(i).~manager<guard>();
+        munmap(Base[i], Size);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+unsigned long numa_arenas<guard, max_nodes>::online()
+{
+    unsigned long mask = 0;
+#if defined(__linux__)
+    // Node list looks like "0-1,3"
+    FILE *f = fopen("/sys/devices/system/node/online", "r");
+    if( f )
+    {
+        unsigned first, last;
+        int n;
+        while( (n = fscanf(f, "%u-%u", &first, &last)) >= 1 )
+        {
+            if( n == 1 )
+                last = first;
+            for(unsigned i = first; i <= last && i < max_nodes; ++i)
+                mask |= 1ul << i;
+            if( fgetc(f) != ',' )
+                break;
+        }
+        fclose(f);
+    }
+#endif
+    return mask ? mask : 1;                    // single node host
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+size_t numa_arenas<guard, max_nodes>::current()
+{
+    // Node of a thread does not depend on the arena set, so the cache
+    // may be shared by all instances
+    static thread_local size_t   Node  = 0;
+    static thread_local unsigned Calls = 0;
+    if( Calls++ % NODE_REFRESH == 0 )
+        Node = query();
+    return Node;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+size_t numa_arenas<guard, max_nodes>::query()
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    if( syscall(SYS_getcpu, &cpu, &node, 0) == 0 )
+        return node;
+#endif
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+void numa_arenas<guard, max_nodes>::bind(void *addr, size_t size, size_t node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    static int const MPOL_BIND_POLICY = 2;     // MPOL_BIND from <numaif.h>
+    unsigned long nodemask = 1ul << node;
+    syscall(SYS_mbind, addr, size, MPOL_BIND_POLICY, &nodemask, sizeof(nodemask) * 8, 0);
+#else
+    (void)addr;
+    (void)size;
+    (void)node;
+#endif
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+manager<guard> * numa_arenas<guard, max_nodes>::owner(void *ptr)
+{
+    if( !Nodes )
+        return 0;
+
+    manager<guard> *Owner = (manager<guard> *)map().get(ptr).owner();
+    if( Owner )
+        return Owner;
+
+    // The last partial page of arena or the map is out of memory
+    for(size_t i = 0; i < Nodes; ++i)
+    {
+        if( Base[i] && (uintptr_t)ptr - (uintptr_t)Base[i] < Size )
+            return &arena(i);
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+void * numa_arenas<guard, max_nodes>::malloc( size_t size )
+{
+    size_t local = current();
+    if( local < Nodes && Base[local] )
+    {
+        void *Allocated = arena(local).malloc(size);
+        if( Allocated )
+            return Allocated;
+    }
+
+    // Local arena is exhausted - use remote ones
+    for(size_t i = 0; i < Nodes; ++i)
+    {
+        if( i == local || !Base[i] )
+            continue;
+        void *Allocated = arena(i).malloc(size);
+        if( Allocated )
+            return Allocated;
+    }
+    return 0;                                  // No Memory
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+void numa_arenas<guard, max_nodes>::free( void *ptr )
+{
+    manager<guard> *Owner = owner(ptr);
+    if( Owner )
+        Owner->free(ptr);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t max_nodes>
+typename manager<guard>::summary numa_arenas<guard, max_nodes>::info()
+{
+    typename manager<guard>::summary Result =
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 }
+    };
+
+    for(size_t i = 0; i < Nodes; ++i)
+    {
+        if( Base[i] )
+            Result.merge(arena(i).info());
+    }
+    return Result;
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_NUMA_H__
+
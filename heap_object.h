@@ -0,0 +1,235 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Typed object allocation with compile-time size dispatch
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_OBJECT_H__
+#define HEAP_OBJECT_H__
+
+//------------------------------------------------------------------------------
+//  Object Heap
+//  ~~~~~~~~~~~
+//
+//    Objects up to 128 bytes are placed into node pools of four size 
+//    classes (16, 32, 64 and 128 bytes), larger objects go to the heap 
+//    manager:
+//
+//      sizeof(T):   1..16   17..32   33..64   65..128   129..
+//                     |        |        |        |         |
+//                  pool 0   pool 1   pool 2   pool 3    manager
+//
+//    make<T>() and destroy() select the size class at compile time, so the
+//    fast path is inlined lock-free pop or push of the node pool. Class 
+//    mixin 'pooled' routes operator new/delete of the class to the object
+//    heap; the size is a constant there, so the selection is folded by 
+//    the compiler as well.
+//
+//    When node pool reaches its block limit, objects of its class are 
+//    allocated by the manager; deallocation returns pointers that are not
+//    owned by the pool to the manager. All objects are aligned to ALIGN.
+//------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include "heap.h"
+#include "heap_nodepool.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t nodes_per_block = 64, size_t max_blocks = 16>
+class object_heap
+{
+public:
+    object_heap(manager<guard> & heap_obj);
+
+    // Alignment of allocated objects. Nodes of a class are aligned to 
+    // alignof(max_align_t) if the class size is a multiple of it, and to
+    // alignment of node pool link otherwise. Class sizes are multiples of
+    // 16, so the 16-byte class has the weakest alignment and the others
+    // give the same or stronger one. Objects allocated by the manager are
+    // aligned to ALIGN
+    static size_t const ALIGN = node_pool<guard, 16, nodes_per_block, max_blocks>::ALIGN;
+
+    // Allocate memory for 'size' bytes object, size class is selected
+    // at compile time. In case of lack of memory the function returns NULL
+    template<size_t size> void *allocate()              { return get(tag<size_class(size)>(), size); }
+    template<size_t size> void  deallocate(void *ptr)   { put(tag<size_class(size)>(), ptr); }
+
+    // The same with run-time size, for operator new/delete
+    void *allocate(size_t size);
+    void  deallocate(void *ptr, size_t size);
+
+    // Create object of type T, returns NULL in case of lack of memory
+    template<typename T, typename... Args>
+    T *make(Args &&... args);
+
+    // Destroy object created by make<T>()
+    template<typename T>
+    void destroy(T *obj);
+
+private:
+    static unsigned const CLASSES = 4;
+
+    static constexpr unsigned size_class(size_t size)
+    {
+        return size <= 16 ? 0 : size <= 32 ? 1 : size <= 64 ? 2 : size <= 128 ? 3 : CLASSES;
+    }
+
+    template<unsigned index> struct tag { };
+
+    // Node pool of the class, the manager if the pool is exhausted
+    template<typename pool_type>
+    void *get(pool_type & pool, size_t size)
+    {
+        void *ptr = pool.malloc();
+        return ptr ? ptr : Heap.malloc_aligned(size, ALIGN);
+    }
+
+    // Node pool of the class, the manager if the pool does not own 'ptr'
+    template<typename pool_type>
+    void put(pool_type & pool, void *ptr)
+    {
+        if( !pool.free(ptr) )
+            Heap.free(ptr);
+    }
+
+    void *get(tag<0>, size_t size)  { return get(Pool16, size); }
+    void *get(tag<1>, size_t size)  { return get(Pool32, size); }
+    void *get(tag<2>, size_t size)  { return get(Pool64, size); }
+    void *get(tag<3>, size_t size)  { return get(Pool128, size); }
+    void *get(tag<CLASSES>, size_t size) { return Heap.malloc_aligned(size, ALIGN); }
+
+    void  put(tag<0>, void *ptr)    { put(Pool16, ptr); }
+    void  put(tag<1>, void *ptr)    { put(Pool32, ptr); }
+    void  put(tag<2>, void *ptr)    { put(Pool64, ptr); }
+    void  put(tag<3>, void *ptr)    { put(Pool128, ptr); }
+    void  put(tag<CLASSES>, void *ptr) { Heap.free(ptr); }
+
+    manager<guard> & Heap;
+    node_pool<guard,  16, nodes_per_block, max_blocks> Pool16;
+    node_pool<guard,  32, nodes_per_block, max_blocks> Pool32;
+    node_pool<guard,  64, nodes_per_block, max_blocks> Pool64;
+    node_pool<guard, 128, nodes_per_block, max_blocks> Pool128;
+};
+
+//------------------------------------------------------------------------------
+//  Class mixin: struct item : heap::pooled<decltype(Objects), Objects> { ... };
+//  Class with virtual destructor gets real object size in operator delete.
+//  Alignment of the class must not exceed objects_type::ALIGN
+template <typename objects_type, objects_type & objects>
+class pooled
+{
+public:
+    static void *operator new(size_t size) noexcept    { return objects.allocate(size); }
+    static void  operator delete(void *ptr, size_t size) { objects.deallocate(ptr, size); }
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t nodes_per_block, size_t max_blocks>
+object_heap<guard, nodes_per_block, max_blocks>::object_heap(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Pool16(heap_obj)
+    , Pool32(heap_obj)
+    , Pool64(heap_obj)
+    , Pool128(heap_obj)
+{
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t nodes_per_block, size_t max_blocks>
+void * object_heap<guard, nodes_per_block, max_blocks>::allocate(size_t size)
+{
+    switch( size_class(size) )
+    {
+    case 0:  return get(tag<0>(), size);
+    case 1:  return get(tag<1>(), size);
+    case 2:  return get(tag<2>(), size);
+    case 3:  return get(tag<3>(), size);
+    default: return get(tag<CLASSES>(), size);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t nodes_per_block, size_t max_blocks>
+void object_heap<guard, nodes_per_block, max_blocks>::deallocate(void *ptr, size_t size)
+{
+    switch( size_class(size) )
+    {
+    case 0:  put(tag<0>(), ptr); break;
+    case 1:  put(tag<1>(), ptr); break;
+    case 2:  put(tag<2>(), ptr); break;
+    case 3:  put(tag<3>(), ptr); break;
+    default: put(tag<CLASSES>(), ptr); break;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t nodes_per_block, size_t max_blocks>
+template<typename T, typename... Args>
+T * object_heap<guard, nodes_per_block, max_blocks>::make(Args &&... args)
+{
+    static_assert(alignof(T) <= ALIGN, "object heap does not provide alignment of the type");
+
+    void *ptr = allocate<sizeof(T)>();
+    return ptr ? new (ptr) T(std::forward<Args>(args)...) : 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t nodes_per_block, size_t max_blocks>
+template<typename T>
+void object_heap<guard, nodes_per_block, max_blocks>::destroy(T *obj)
+{
+    if( !obj )
+        return;
+    obj->~T();
+    deallocate<sizeof(T)>(obj);
+}
+
+//------------------------------------------------------------------------------
+//  heap::make<T>(Objects, args...) and heap::destroy(Objects, ptr)
+template <typename T, typename guard, size_t nodes_per_block, size_t max_blocks, typename... Args>
+inline T *make(object_heap<guard, nodes_per_block, max_blocks> & objects, Args &&... args)
+{
+    return objects.template make<T>(std::forward<Args>(args)...);
+}
+
+template <typename T, typename guard, size_t nodes_per_block, size_t max_blocks>
+inline void destroy(object_heap<guard, nodes_per_block, max_blocks> & objects, T *obj)
+{
+    objects.destroy(obj);
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_OBJECT_H__
+
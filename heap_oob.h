@@ -0,0 +1,295 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Heap manager with out-of-band chunk metadata
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_OOB_H__
+#define HEAP_OOB_H__
+
+//------------------------------------------------------------------------------
+//  Out-of-Band Heap Structure
+//  ~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+//    Pool is divided into the metadata table and the data area. Data area
+//    consists of N granules, chunk occupies an integer number of granules.
+//    Table holds one entry per granule:
+//
+//    +----+----+-...-+----+-----+-------------+-------------+-...-+---------+
+//    | e0 | e1 |     | eN | pad |  granule 0  |  granule 1  |     |granule N|
+//    +----+----+-...-+----+-----+-------------+-------------+-...-+---------+
+//
+//    Entry of the first granule of a chunk (HEAD) and entry of its last
+//    granule (TAIL) hold chunk size in granules and USED flag, entries of
+//    inner granules are zero. Chunk of one granule has both HEAD and TAIL
+//    flags in the same entry.
+//
+//    Heap walk goes over the table only: i += size(e[i]), so the search for
+//    free chunk touches 4 bytes per chunk in dense memory and never loads
+//    cache lines of user data. TAIL entry gives O(1) access to the previous
+//    chunk for merging. Since there is no header in front of the user data,
+//    buffer overrun can not break heap structure, and free() validates the
+//    pointer against the table.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule = 16>
+class oob_manager
+{
+public:
+    typedef typename manager<guard>::summary summary;
+
+    // Heap initialization
+    template<size_t size_items>
+    oob_manager(int (& pool)[size_items]);
+
+    template<size_t size_bytes>
+    oob_manager(pool<size_bytes> & pool_obj);
+
+    oob_manager(int * pool, size_t size_bytes);
+
+    // Allocate 'size' bytes, returned pointer is aligned to granule. In case
+    // of lack of memory the function returns NULL.
+    void *malloc( size_t size );
+
+    // Deallocates memory pointed by 'ptr'. Pointers that were not returned
+    // by malloc() or were already released are ignored
+    void free( void *ptr );
+
+    // Info about count and sizes of free and allocated memory chunks
+    summary info();
+
+private:
+    typedef uint32_t entry;
+
+    static entry const USED = (entry)1 << 31;
+    static entry const HEAD = (entry)1 << 30;
+    static entry const TAIL = (entry)1 << 29;
+    static entry const SIZE = TAIL - 1;
+
+    static_assert(granule >= sizeof(void *) && !(granule & (granule - 1)), "granule must be power of 2");
+
+    void init(int * pool, size_t size_bytes);
+
+    // write HEAD and TAIL entries of chunk [index, index + size)
+    void mark(size_t index, size_t size, entry used);
+
+    entry  *Table;         // metadata table
+    char   *Data;          // data area, granule aligned
+    size_t  Count;         // number of granules
+    size_t  Hint;          // index of the first free chunk or below
+
+    guard   Guard;         // thread-safe support
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+template<size_t size_items>
+oob_manager<guard, granule>::oob_manager(int (& pool)[size_items])
+    : Guard()
+{
+    init(pool, sizeof(pool));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+template<size_t size_bytes>
+oob_manager<guard, granule>::oob_manager(pool<size_bytes> & pool_obj)
+    : Guard()
+{
+    init(pool_obj.Pool, sizeof(pool_obj));
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+oob_manager<guard, granule>::oob_manager(int * pool, size_t size_bytes)
+    : Guard()
+{
+    init(pool, size_bytes);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void oob_manager<guard, granule>::init(int * pool, size_t size_bytes)
+{
+    uintptr_t begin = (uintptr_t)pool;
+    uintptr_t end   = begin + size_bytes;
+
+    Table = (entry *)pool;
+    Count = size_bytes / (granule + sizeof(entry));
+    for(;;)
+    {
+        uintptr_t data = (begin + Count * sizeof(entry) + granule - 1) & ~(uintptr_t)(granule - 1);
+        if( data + Count * granule <= end )
+        {
+            Data = (char *)data;
+            break;
+        }
+        --Count;                                // alignment padding took the last granule
+    }
+
+    for(size_t i = 0; i < Count; ++i)
+        Table[i] = 0;
+    Hint = 0;
+    if( Count )
+        mark(0, Count, 0);                      // heap is one free chunk
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void oob_manager<guard, granule>::mark(size_t index, size_t size, entry used)
+{
+    if( size == 1 )
+    {
+        Table[index] = HEAD | TAIL | used | 1;
+    }
+    else
+    {
+        Table[index] = HEAD | used | (entry)size;
+        Table[index + size - 1] = TAIL | used | (entry)size;
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void * oob_manager<guard, granule>::malloc( size_t size )
+{
+    if( size > Count * granule )                // larger than the heap, rounding would wrap
+        return 0;
+
+    size_t need = size ? (size + granule - 1) / granule : 1;
+    if( need > SIZE )
+        return 0;
+
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+
+    // First fit over the table
+    size_t i = Hint;
+    bool   first = true;                        // no free chunks have been passed
+    while( i < Count )
+    {
+        entry  e = Table[i];
+        size_t n = e & SIZE;
+        if( !(e & USED) )
+        {
+            if( n >= need )
+            {
+                mark(i, need, USED);
+                if( n > need )
+                    mark(i + need, n - need, 0);    // the rest stays free
+                if( first )
+                    Hint = i + need;
+                return Data + i * granule;
+            }
+            first = false;
+        }
+        i += n;
+    }
+    return 0;                                   // No Memory
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+void oob_manager<guard, granule>::free( void *ptr )
+{
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)Data;
+    if( !ptr || offset >= Count * granule || offset % granule )
+        return;
+
+    size_t index = offset / granule;
+
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+
+    entry e = Table[index];
+    if( (e & (HEAD | USED)) != (HEAD | USED) )  // not a chunk or chunk is free already
+        return;
+
+    size_t size = e & SIZE;
+
+    // Join with the next chunk
+    size_t next = index + size;
+    if( next < Count && !(Table[next] & USED) )
+    {
+        size_t n = Table[next] & SIZE;
+        Table[index + size - 1] = 0;            // inner boundary entries are cleared
+        Table[next] = 0;
+        size += n;
+    }
+
+    // Join with the previous chunk
+    if( index && !(Table[index - 1] & USED) )
+    {
+        size_t n = Table[index - 1] & SIZE;
+        Table[index - 1] = 0;
+        Table[index] = 0;
+        index -= n;
+        size  += n;
+    }
+
+    mark(index, size, 0);
+    if( index < Hint )
+        Hint = index;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, size_t granule>
+typename oob_manager<guard, granule>::summary oob_manager<guard, granule>::info()
+{
+    summary Result =
+    {
+        { 0, 0, 0 },
+        { 0, 0, 0 }
+    };
+
+    shared_scope_guard<guard> ScopeGuard(Guard);    // protect the following code from asyncronous modification
+    for(size_t i = 0; i < Count; )
+    {
+        entry  e = Table[i];
+        size_t n = (e & SIZE) * granule;
+        typename summary::info * pInfo = e & USED ? &Result.Used : &Result.Free;
+        ++pInfo->Blocks;
+        pInfo->Size += n;
+        if( pInfo->Block_max_size < n )
+            pInfo->Block_max_size = n;
+        i += e & SIZE;
+    }
+    return Result;
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_OOB_H__
+
@@ -0,0 +1,276 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Radix tree page map from address to owner
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_PAGEMAP_H__
+#define HEAP_PAGEMAP_H__
+
+//------------------------------------------------------------------------------
+//  Page Map Structure
+//  ~~~~~~~~~~~~~~~~~~
+//
+//    Address space is divided into pages of 2^page_bits bytes. Page number
+//    is split into three indexes of the radix tree:
+//
+//      address: | root index | mid index | leaf index | page offset |
+//
+//    Root level is a part of the map object, mid and leaf nodes are taken
+//    from heap manager when the first page of their range is set, and
+//    are never released until the map is destroyed:
+//
+//      Root[r] -> mid node[m] -> leaf node[l] -> value
+//
+//    Lookup is three dependent loads without any lock, so it can be used
+//    by free() to find the arena or pool that owns a pointer and to reject
+//    pointers that do not belong to any registered pool. Updates are
+//    serialized by the map guard; nodes are published with release stores,
+//    so concurrent lookups see either the old or the new value.
+//
+//    Default value is page_entry: owner object (heap manager) and a small
+//    index (arena number, size class) packed into one word. Heap managers
+//    register their pools by manager::map_pages(), then free() of any of
+//    them ignores pointers to pages of other owners, and arena sets route
+//    pointers to the owner arena by single lookup.
+//------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+// Owner pointer and index packed into one word, owner must be aligned to 
+// 2^INDEX_BITS bytes. Default value has no owner
+class page_entry
+{
+public:
+    static unsigned const INDEX_BITS = 2;
+    static unsigned const INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+    page_entry() : Word(0) { }
+    page_entry(void *owner, unsigned index) : Word((uintptr_t)owner | (index & INDEX_MASK)) { }
+
+    void    *owner() const { return (void *)(Word & ~(uintptr_t)INDEX_MASK); }
+    unsigned index() const { return Word & INDEX_MASK; }
+
+private:
+    uintptr_t Word;
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type = page_entry, unsigned page_bits = 12>
+class page_map
+{
+public:
+    typedef value_type entry_type;
+
+    static size_t const PAGE_SIZE = (size_t)1 << page_bits;
+
+    page_map(manager<guard> & heap_obj);
+    ~page_map();
+
+    // Assign 'value' to all pages that overlap [begin, begin + size).
+    // Returns false if heap manager has no memory for tree nodes or
+    // address is out of map range, the pages are left unchanged then
+    bool set(void const *begin, size_t size, value_type value);
+
+    // The same for pages that lie entirely within [begin, begin + size),
+    // pages shared with other memory are left unchanged
+    bool set_within(void const *begin, size_t size, value_type value);
+
+    // Reset pages that overlap [begin, begin + size) to value_type()
+    void clear(void const *begin, size_t size);
+
+    // Value of the page 'ptr' points to, value_type() for unknown pages
+    value_type get(void const *ptr) const;
+
+private:
+    static unsigned const ADDRESS_BITS = sizeof(void *) > 4 ? 48 : 32;
+    static unsigned const KEY_BITS     = ADDRESS_BITS - page_bits;
+    static unsigned const LEAF_BITS    = KEY_BITS / 3;
+    static unsigned const MID_BITS     = KEY_BITS / 3;
+    static unsigned const ROOT_BITS    = KEY_BITS - LEAF_BITS - MID_BITS;
+
+    static size_t const LEAF_SIZE = (size_t)1 << LEAF_BITS;
+    static size_t const MID_SIZE  = (size_t)1 << MID_BITS;
+    static size_t const ROOT_SIZE = (size_t)1 << ROOT_BITS;
+
+    struct leaf { std::atomic<value_type> Value[LEAF_SIZE]; };
+    struct mid  { std::atomic<leaf *>     Leaf[MID_SIZE];   };
+
+    leaf * node(uintptr_t key);                 // get or create leaf node for page key
+
+    manager<guard>    & Heap;
+    guard               Guard;                  // serializes updates
+    std::atomic<mid *>  Root[ROOT_SIZE];
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+page_map<guard, value_type, page_bits>::page_map(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Guard()
+{
+    for(size_t i = 0; i < ROOT_SIZE; ++i)
+        Root[i].store(0, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+page_map<guard, value_type, page_bits>::~page_map()
+{
+    for(size_t i = 0; i < ROOT_SIZE; ++i)
+    {
+        mid *pMid = Root[i].load(std::memory_order_relaxed);
+        if( !pMid )
+            continue;
+        for(size_t j = 0; j < MID_SIZE; ++j)
+            Heap.free(pMid->Leaf[j].load(std::memory_order_relaxed));
+        Heap.free(pMid);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+typename page_map<guard, value_type, page_bits>::leaf *
+page_map<guard, value_type, page_bits>::node(uintptr_t key)
+{
+    std::atomic<mid *> & Slot = Root[key >> (LEAF_BITS + MID_BITS)];
+    mid *pMid = Slot.load(std::memory_order_relaxed);
+    if( !pMid )
+    {
+        pMid = (mid *)Heap.malloc_aligned(sizeof(mid), alignof(mid));
+        if( !pMid )
+            return 0;
+        for(size_t i = 0; i < MID_SIZE; ++i)
+            pMid->Leaf[i].store(0, std::memory_order_relaxed);
+        Slot.store(pMid, std::memory_order_release);
+    }
+
+    std::atomic<leaf *> & Entry = pMid->Leaf[(key >> LEAF_BITS) & (MID_SIZE - 1)];
+    leaf *pLeaf = Entry.load(std::memory_order_relaxed);
+    if( !pLeaf )
+    {
+        pLeaf = (leaf *)Heap.malloc_aligned(sizeof(leaf), alignof(leaf));
+        if( !pLeaf )
+            return 0;
+        for(size_t i = 0; i < LEAF_SIZE; ++i)
+            pLeaf->Value[i].store(value_type(), std::memory_order_relaxed);
+        Entry.store(pLeaf, std::memory_order_release);
+    }
+    return pLeaf;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+bool page_map<guard, value_type, page_bits>::set(void const *begin, size_t size, value_type value)
+{
+    if( !size )
+        return true;
+
+    uintptr_t first = (uintptr_t)begin >> page_bits;
+    uintptr_t last  = ((uintptr_t)begin + size - 1) >> page_bits;
+    if( last >> KEY_BITS || last < first )
+        return false;
+
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+
+    // Create all nodes of the range first, so that failure leaves no 
+    // partial mapping. Created nodes hold default values and are kept
+    for(uintptr_t key = first; key <= last; key = (key | (LEAF_SIZE - 1)) + 1)
+    {
+        if( !node(key) )
+            return false;
+        if( (key | (LEAF_SIZE - 1)) >= last )
+            break;
+    }
+    for(uintptr_t key = first; key <= last; ++key)
+        node(key)->Value[key & (LEAF_SIZE - 1)].store(value, std::memory_order_release);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+bool page_map<guard, value_type, page_bits>::set_within(void const *begin, size_t size, value_type value)
+{
+    uintptr_t first = ((uintptr_t)begin + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+    uintptr_t end   = ((uintptr_t)begin + size) & ~(uintptr_t)(PAGE_SIZE - 1);
+    if( end <= first || first < (uintptr_t)begin )
+        return true;                            // no whole page
+    return set((void const *)first, end - first, value);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+void page_map<guard, value_type, page_bits>::clear(void const *begin, size_t size)
+{
+    if( !size )
+        return;
+
+    uintptr_t first = (uintptr_t)begin >> page_bits;
+    uintptr_t last  = ((uintptr_t)begin + size - 1) >> page_bits;
+
+    scope_guard<guard> ScopeGuard(Guard);       // protect the following code from asyncronous access
+    for(uintptr_t key = first; key <= last && !(key >> KEY_BITS); ++key)
+    {
+        mid *pMid = Root[key >> (LEAF_BITS + MID_BITS)].load(std::memory_order_relaxed);
+        if( !pMid )
+            continue;
+        leaf *pLeaf = pMid->Leaf[(key >> LEAF_BITS) & (MID_SIZE - 1)].load(std::memory_order_relaxed);
+        if( pLeaf )
+            pLeaf->Value[key & (LEAF_SIZE - 1)].store(value_type(), std::memory_order_release);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename value_type, unsigned page_bits>
+value_type page_map<guard, value_type, page_bits>::get(void const *ptr) const
+{
+    uintptr_t key = (uintptr_t)ptr >> page_bits;
+    if( key >> KEY_BITS )
+        return value_type();
+
+    mid *pMid = Root[key >> (LEAF_BITS + MID_BITS)].load(std::memory_order_acquire);
+    if( !pMid )
+        return value_type();
+    leaf *pLeaf = pMid->Leaf[(key >> LEAF_BITS) & (MID_SIZE - 1)].load(std::memory_order_acquire);
+    if( !pLeaf )
+        return value_type();
+    return pLeaf->Value[key & (LEAF_SIZE - 1)].load(std::memory_order_acquire);
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_PAGEMAP_H__
+
@@ -0,0 +1,311 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     C++ design by Sergey A. Borshch
+//*
+//*     Description: Heap-backed growable vector and byte buffer
+//*
+//*     The code is distributed under the MIT license terms:
+//*
+//*     Permission is hereby granted, free of charge, to any person
+//*     obtaining  a copy of this software and associated documentation
+//*     files (the "Software"), to deal in the Software without restriction,
+//*     including without limitation the rights to use, copy, modify, merge,
+//*     publish, distribute, sublicense, and/or sell copies of the Software,
+//*     and to permit persons to whom the Software is furnished to do so,
+//*     subject to the following conditions:
+//*
+//*     The above copyright notice and this permission notice shall be included
+//*     in all copies or substantial portions of the Software.
+//*
+//*     THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//*     EXPRESS  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+//*     MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+//*     IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+//*     CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+//*     TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+//*     THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//*
+//*-----------------------------------------------------------------------------
+#ifndef HEAP_VECTOR_H__
+#define HEAP_VECTOR_H__
+
+//------------------------------------------------------------------------------
+//  Heap Vector
+//  ~~~~~~~~~~~
+//
+//    Storage of the vector is a single heap chunk. When the vector grows,
+//    the chunk is first expanded in place by joining the free chunk that
+//    follows it, the elements are relocated to a new chunk only if that
+//    fails. Capacity is taken from usable size of the chunk, so rounding
+//    slack of the heap is also used for elements. Storage is aligned to
+//    alignof(T), in-place expansion keeps its address and so its alignment.
+//
+//    Functions that may allocate return false in case of lack of memory
+//    or if the size in bytes does not fit into size_t, the vector is left
+//    unchanged then.
+//------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <string.h>
+#include <new>
+#include <utility>
+#include "heap.h"
+
+namespace heap
+{
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+class vector
+{
+public:
+    vector(manager<guard> & heap_obj);
+    vector(vector && other);
+    ~vector();
+
+    size_t   size()     const { return Size; }
+    size_t   capacity() const { return Capacity; }
+    bool     empty()    const { return !Size; }
+
+    T       *data()           { return Data; }
+    T const *data()     const { return Data; }
+    T       *begin()          { return Data; }
+    T       *end()            { return Data + Size; }
+    T const *begin()    const { return Data; }
+    T const *end()      const { return Data + Size; }
+
+    T       & operator[](size_t index)       { return Data[index]; }
+    T const & operator[](size_t index) const { return Data[index]; }
+
+    // Make capacity at least 'count' elements
+    bool reserve(size_t count);
+
+    // Change number of elements, new elements are value-initialized
+    bool resize(size_t count);
+
+    bool push_back(T const & value);
+    bool push_back(T && value);
+
+    // Append 'count' elements copied from 'src'
+    bool append(T const *src, size_t count);
+
+    void pop_back();
+    void clear();
+
+    // Return unused capacity to the heap, storage is released if empty
+    void shrink_to_fit();
+
+private:
+    vector(vector const &);
+    vector & operator=(vector const &);
+
+    // The largest number of elements whose size in bytes fits into size_t
+    static size_t const MAX_COUNT = ~(size_t)0 / sizeof(T);
+
+    // expand() the chunk to 'count' elements, false if capacity is still 
+    // less than 'count'
+    bool expand(size_t count);
+
+    // Provide room for 'count' elements growing geometrically
+    bool grow(size_t count);
+
+    // Move elements to new chunk of 'count' elements
+    bool relocate(size_t count);
+
+    manager<guard> & Heap;
+    T               *Data;
+    size_t           Size;
+    size_t           Capacity;
+};
+
+//------------------------------------------------------------------------------
+template <typename guard>
+class byte_buffer : public vector<guard, char>
+{
+public:
+    byte_buffer(manager<guard> & heap_obj) : vector<guard, char>(heap_obj) { }
+
+    bool append(void const *src, size_t count) { return vector<guard, char>::append((char const *)src, count); }
+    bool append(char const *str)               { return append(str, strlen(str)); }
+};
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+vector<guard, T>::vector(manager<guard> & heap_obj)
+    : Heap(heap_obj)
+    , Data(0)
+    , Size(0)
+    , Capacity(0)
+{
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+vector<guard, T>::vector(vector && other)
+    : Heap(other.Heap)
+    , Data(other.Data)
+    , Size(other.Size)
+    , Capacity(other.Capacity)
+{
+    other.Data     = 0;
+    other.Size     = 0;
+    other.Capacity = 0;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+vector<guard, T>::~vector()
+{
+    clear();
+    Heap.free(Data);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::relocate(size_t count)
+{
+    if( count > MAX_COUNT )
+        return false;
+
+    T *New = (T *)Heap.malloc_aligned(count * sizeof(T), alignof(T));
+    if( !New )
+        return false;
+    if( Heap.usable_size(New) / sizeof(T) < count )      // size was wrapped by the heap
+    {
+        Heap.free(New);
+        return false;
+    }
+
+    for(size_t i = 0; i < Size; ++i)
+    {
+        new (New + i) T(std::move(Data[i]));
+        Data[i].~T();
+    }
+    Heap.free(Data);
+    Data     = New;
+    Capacity = Heap.usable_size(Data) / sizeof(T);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::reserve(size_t count)
+{
+    if( count <= Capacity )
+        return true;
+
+    return expand(count) || relocate(count);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::expand(size_t count)
+{
+    if( !Data || count > MAX_COUNT || !Heap.expand(Data, count * sizeof(T)) )
+        return false;
+
+    Capacity = Heap.usable_size(Data) / sizeof(T);
+    return Capacity >= count;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::grow(size_t count)
+{
+    if( count <= Capacity )
+        return true;
+
+    size_t want = Capacity < MAX_COUNT / 3 * 2 ? Capacity + Capacity / 2 : MAX_COUNT;
+    if( want < count )
+        want = count;
+
+    // In place growth to geometric size, then to exact size,
+    // relocation is the last resort
+    return expand(want) || expand(count) || relocate(want) || relocate(count);
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::resize(size_t count)
+{
+    if( !reserve(count) )
+        return false;
+
+    while( Size < count )
+        new (Data + Size++) T();
+    while( Size > count )
+        Data[--Size].~T();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::push_back(T const & value)
+{
+    if( !grow(Size + 1) )
+        return false;
+    new (Data + Size++) T(value);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::push_back(T && value)
+{
+    if( !grow(Size + 1) )
+        return false;
+    new (Data + Size++) T(std::move(value));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+bool vector<guard, T>::append(T const *src, size_t count)
+{
+    if( count > MAX_COUNT - Size || !grow(Size + count) )
+        return false;
+    for(size_t i = 0; i < count; ++i)
+        new (Data + Size++) T(src[i]);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+void vector<guard, T>::pop_back()
+{
+    Data[--Size].~T();
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+void vector<guard, T>::clear()
+{
+    while( Size )
+        Data[--Size].~T();
+}
+
+//------------------------------------------------------------------------------
+template <typename guard, typename T>
+void vector<guard, T>::shrink_to_fit()
+{
+    if( Size == Capacity )
+        return;
+
+    if( !Size )
+    {
+        Heap.free(Data);
+        Data     = 0;
+        Capacity = 0;
+        return;
+    }
+    relocate(Size);
+}
+//------------------------------------------------------------------------------
+
+} // namespace heap
+//------------------------------------------------------------------------------
+
+#endif  // HEAP_VECTOR_H__
+
@@ -0,0 +1,50 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Bitmap heap regression checks
+//*
+//*     Build: g++ -O2 -std=c++17 -I bench -I . test/bitmap.cpp -o bitmap_test
+//*     Run:   ./bitmap_test
+//*
+//*     Requests larger than the heap, including sizes whose rounding to
+//*     granule wraps, must fail and leave the heap unchanged.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdint.h>
+#include "heap.h"
+#include "heap_bitmap.h"
+
+typedef heap::bitmap_manager<heap_guard, 16> bitmap;
+
+#define CHECK(x) do { if( !(x) ) { printf("%s:%d: %s\n", __FILE__, __LINE__, #x); return 1; } } while( 0 )
+
+static int HeapPool[(64 << 10) / sizeof(int)];
+
+//------------------------------------------------------------------------------
+int main()
+{
+    bitmap Heap(HeapPool);
+    bitmap::summary before = Heap.info();
+
+    CHECK(!Heap.malloc(SIZE_MAX));
+    CHECK(!Heap.malloc(SIZE_MAX - 15));
+    CHECK(!Heap.malloc(before.Free.Size + 1));
+
+    bitmap::summary after = Heap.info();
+    CHECK(after.Used.Blocks == 0 && after.Free.Size == before.Free.Size);
+
+    char *a = (char *)Heap.malloc(32);
+    char *b = (char *)Heap.malloc(32);
+    CHECK(a && b && (a + 32 <= b || b + 32 <= a));
+
+    Heap.free(a);
+    Heap.free(b);
+    void *all = Heap.malloc(before.Free.Size);
+    CHECK(all);
+    Heap.free(all);
+
+    puts("ok");
+    return 0;
+}
@@ -0,0 +1,86 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Epoch reclamation regression checks
+//*
+//*     Build: g++ -O2 -std=c++17 -pthread -I bench -I . test/epoch.cpp -o epoch_test
+//*     Run:   ./epoch_test
+//*
+//*     Threads with their own participants retire memory and exit before 
+//*     the reclaimer while another thread keeps collecting. Participants
+//*     are heap objects, so a record left attached after its thread exits
+//*     is caught by address sanitizer (-fsanitize=address). All retired
+//*     memory must be returned to the heap.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "heap.h"
+#include "heap_epoch.h"
+
+typedef heap::manager<heap_guard>   manager;
+typedef heap::reclaimer<heap_guard> reclaimer;
+
+#define CHECK(x) do { if( !(x) ) { printf("%s:%d: %s\n", __FILE__, __LINE__, #x); return 1; } } while( 0 )
+
+static int     HeapPool[(1 << 20) / sizeof(int)];
+static manager Heap(HeapPool);
+
+//------------------------------------------------------------------------------
+static void retire_some(reclaimer & Reclaimer, reclaimer::participant & p, size_t count)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        Reclaimer.enter(p);
+        void *ptr = Heap.malloc(32);
+        Reclaimer.exit(p);
+        if( ptr && !Reclaimer.retire(p, ptr) )
+            Heap.free(ptr);
+    }
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+    {
+        reclaimer Reclaimer(Heap);
+        std::atomic<bool> Done(false);
+
+        // Long-living thread keeps scanning participants
+        std::thread collector([&]()
+        {
+            reclaimer::participant p;
+            Reclaimer.attach(p);
+            while( !Done.load() )
+                retire_some(Reclaimer, p, 100);
+            Reclaimer.flush(p);
+        });
+
+        // Short-living threads exit before the reclaimer
+        for(int round = 0; round < 50; ++round)
+        {
+            std::vector<std::thread> workers;
+            for(int t = 0; t < 4; ++t)
+            {
+                workers.push_back(std::thread([&]()
+                {
+                    reclaimer::participant *p = new reclaimer::participant;
+                    Reclaimer.attach(*p);
+                    retire_some(Reclaimer, *p, 200);
+                    delete p;
+                }));
+            }
+            for(size_t t = 0; t < workers.size(); ++t)
+                workers[t].join();
+        }
+        Done.store(true);
+        collector.join();
+    }
+    CHECK(Heap.info().Used.Blocks == 0);
+
+    puts("ok");
+    return 0;
+}
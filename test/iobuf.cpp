@@ -0,0 +1,62 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Buffer chain regression checks
+//*
+//*     Build: g++ -O2 -std=c++17 -I bench -I . test/iobuf.cpp -o iobuf_test
+//*     Run:   ./iobuf_test
+//*
+//*     Appending a range of another chain that runs past its end must fail
+//*     and leave the chain and segment references unchanged.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include "heap.h"
+#include "heap_iobuf.h"
+
+typedef heap::manager<heap_guard>     manager;
+typedef heap::io_chain<heap_guard>    chain;
+typedef heap::io_chain<heap_guard, 4> short_chain;
+
+#define CHECK(x) do { if( !(x) ) { printf("%s:%d: %s\n", __FILE__, __LINE__, #x); return 1; } } while( 0 )
+
+struct iov
+{
+    void  *iov_base;
+    size_t iov_len;
+};
+
+static int     HeapPool[(64 << 10) / sizeof(int)];
+static manager Heap(HeapPool);
+
+//------------------------------------------------------------------------------
+int main()
+{
+    {
+        chain       a(Heap);
+        short_chain b(Heap);
+        memcpy(a.grow(10), "0123456789", 10);
+        memcpy(a.grow(5), "abcde", 5);
+
+        CHECK(b.append(a, 8, 5));
+        iov v[4];
+        CHECK(b.to_iovec(v, 4) == 2);
+        CHECK(v[0].iov_len == 2 && !memcmp(v[0].iov_base, "89", 2));
+        CHECK(v[1].iov_len == 3 && !memcmp(v[1].iov_base, "abc", 3));
+
+        // Range runs past the end: nothing is appended
+        CHECK(!b.append(a, 8, 8));
+        CHECK(!b.append(a, 20, 1));
+        CHECK(b.count() == 2 && b.size() == 5);
+
+        // Segments are released with the last reference
+        a.release();
+        CHECK(Heap.info().Used.Blocks == 2);
+    }
+    CHECK(Heap.info().Used.Blocks == 0);
+
+    puts("ok");
+    return 0;
+}
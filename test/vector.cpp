@@ -0,0 +1,63 @@
+//*-----------------------------------------------------------------------------
+//*
+//*     Heap Manager by Zltigo
+//*
+//*     Description: Heap vector regression checks
+//*
+//*     Build: g++ -O2 -std=c++17 -I bench -I . test/vector.cpp -o vector_test
+//*     Run:   ./vector_test
+//*
+//*     Storage of vectors whose element alignment is stronger than the heap
+//*     alignment must stay aligned while the vector grows in place and is
+//*     relocated. Pool starts 4 bytes off 8-byte boundary.
+//*
+//*-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdint.h>
+#include "heap.h"
+#include "heap_vector.h"
+
+typedef heap::manager<heap_guard> manager;
+
+#define CHECK(x) do { if( !(x) ) { printf("%s:%d: %s\n", __FILE__, __LINE__, #x); return 1; } } while( 0 )
+
+struct alignas(32) wide
+{
+    char Bytes[40];
+};
+
+alignas(8) static int HeapPool[(256 << 10) / sizeof(int)];
+static manager        Heap(HeapPool + 1, sizeof(HeapPool) - sizeof(int));
+
+//------------------------------------------------------------------------------
+template<typename T>
+static bool grow_aligned()
+{
+    heap::vector<heap_guard, T> v(Heap);
+    void *spacer[64];
+    for(size_t i = 0; i < 64; ++i)
+    {
+        // Odd sized neighbours force both in-place growth and relocation
+        spacer[i] = Heap.malloc(4 + 4 * (i % 3));
+        for(size_t k = 0; k < 16; ++k)
+        {
+            if( !v.push_back(T()) || (uintptr_t)v.data() % alignof(T) )
+                return false;
+        }
+    }
+    for(size_t i = 0; i < 64; ++i)
+        Heap.free(spacer[i]);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+int main()
+{
+    CHECK(grow_aligned<uint64_t>());
+    CHECK(grow_aligned<double>());
+    CHECK(grow_aligned<wide>());
+    CHECK(Heap.info().Used.Blocks == 0);
+
+    puts("ok");
+    return 0;
+}